@@ -0,0 +1,491 @@
+#include "liquid_sim.h"
+#include "sim_kernels.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <vector>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+//   mLiquidMetalBench [--size WxH] [--steps N] [--substeps K] [--seed S]
+//                     [--threads T] [--mode fused|twopass] [--scalar]
+//                     [--boundary fixed|free|periodic|absorbing]
+//                     [--dense] [--generic] [--no-temporal] [--lut] [--env]
+//                     [--upsample WxH] [--strokes] [--radius R]
+//                     [--storage fp32|fp16|int16] [--idle N]
+//                     [--hugepages off|thp|explicit]
+//
+// Replays a seeded stroke script against a LiquidSim without opening a
+// window or linking raylib: each frame applies the script's impulses, advances the sim and
+// renders into an off-screen RGBA8 buffer. Per-phase timings are reported as
+// min / median / p99 in ns per cell (per output pixel for an upsampled
+// render), followed by the median frame time. The script only draws raw mt19937
+// output, so the workload is identical across standard libraries.
+//
+// With 16-bit storage an untimed dense fp32 twin replays the same script,
+// and the final heights and image are compared against it; --idle then
+// runs both N more steps without input to show how each settles.
+//
+// The kernel variant is picked from the CPU; set MLIQUIDMETAL_KERNELS to
+// scalar, sse4.2, avx2 or avx512 to time another one. Every variant
+// prints the same checksums.
+//
+// --hugepages picks the page backing of the fields (see huge_pages.h). On
+// Linux the step phase's data TLB misses are counted over all threads
+// (when perf events are permitted) and printed per step with how much of
+// the process sits on huge pages. There is no small-page baseline within
+// a run: compare against a separate --hugepages off run of the same grid.
+
+struct BenchStats {
+    std::vector<double> samples; // ns per frame
+
+    void Print(const char *name, double cells) {
+        std::sort(samples.begin(), samples.end());
+        size_t n = samples.size();
+        size_t p99 = (size_t)std::ceil(0.99 * n);
+        p99 = p99 > 0 ? p99 - 1 : 0;
+        printf("%-8s %12.3f %12.3f %12.3f\n", name,
+               samples[0] / cells, samples[n / 2] / cells, samples[p99] / cells);
+    }
+};
+
+// Data TLB load or store misses of this process and every thread it
+// starts afterwards, counted only between Start() and Stop().
+struct TlbMissCounter {
+#if defined(__linux__)
+    int fd = -1;
+
+    explicit TlbMissCounter(bool stores) {
+        unsigned op = stores ? PERF_COUNT_HW_CACHE_OP_WRITE : PERF_COUNT_HW_CACHE_OP_READ;
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_DTLB | (op << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        attr.disabled = 1;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+    ~TlbMissCounter() {
+        if (fd >= 0)
+            close(fd);
+    }
+    bool Available() const { return fd >= 0; }
+    void Start() {
+        if (fd >= 0)
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    void Stop() {
+        if (fd >= 0)
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    }
+    // Includes the threads still running.
+    double Read() const {
+        uint64_t count = 0;
+        if (fd < 0 || read(fd, &count, sizeof(count)) != (ssize_t)sizeof(count))
+            return 0.0;
+        return (double)count;
+    }
+#else
+    explicit TlbMissCounter(bool) {}
+    bool Available() const { return false; }
+    void Start() {}
+    void Stop() {}
+    double Read() const { return 0.0; }
+#endif
+};
+
+// Anonymous memory on transparent huge pages and hugetlb pages in use by
+// this process, in MB; both 0 where unavailable.
+static void HugePageUsage(double &thpMb, double &hugetlbMb) {
+    thpMb = 0.0;
+    hugetlbMb = 0.0;
+    FILE *f = fopen("/proc/self/smaps_rollup", "r");
+    if (!f)
+        return;
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        unsigned long kb;
+        if (sscanf(line, "AnonHugePages: %lu kB", &kb) == 1)
+            thpMb += kb / 1024.0;
+        else if (sscanf(line, "Shared_Hugetlb: %lu kB", &kb) == 1 ||
+                 sscanf(line, "Private_Hugetlb: %lu kB", &kb) == 1)
+            hugetlbMb += kb / 1024.0;
+    }
+    fclose(f);
+}
+
+// Median of the per-frame sum over all phases.
+static double MedianFrameNs(const BenchStats &a, const BenchStats &b, const BenchStats &c) {
+    std::vector<double> total(a.samples.size());
+    for (size_t i = 0; i < total.size(); ++i)
+        total[i] = a.samples[i] + b.samples[i] + c.samples[i];
+    std::sort(total.begin(), total.end());
+    return total[total.size() / 2];
+}
+
+int main(int argc, char **argv) {
+    int simWidth = 2048;
+    int simHeight = 2048;
+    int steps = 500;
+    int substeps = 1;
+    int threads = 0;
+    unsigned seed = 1;
+    LiquidSim::StepMode mode = LiquidSim::StepMode::Fused;
+    LiquidSim::Boundary boundary = LiquidSim::Boundary::Fixed;
+    const char *boundaryName = "fixed";
+    bool scalar = false;
+    bool dense = false;
+    bool generic = false;
+    bool temporal = true;
+    bool lut = false;
+    bool env = false;
+    bool strokes = false;
+    int radius = 3;
+    int outWidth = 0;
+    int outHeight = 0;
+    LiquidSim::Storage storage = LiquidSim::Storage::Float32;
+    const char *storageName = "fp32";
+    int idleSteps = 0;
+    HugePages hugePages = HugePages::Off;
+    const char *hugePagesName = "off";
+
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        const char *next = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (!strcmp(arg, "--size") && next) {
+            if (sscanf(next, "%dx%d", &simWidth, &simHeight) == 1)
+                simHeight = simWidth;
+            ++i;
+        } else if (!strcmp(arg, "--steps") && next) {
+            steps = atoi(next);
+            ++i;
+        } else if (!strcmp(arg, "--substeps") && next) {
+            substeps = atoi(next);
+            ++i;
+        } else if (!strcmp(arg, "--seed") && next) {
+            seed = (unsigned)strtoul(next, nullptr, 10);
+            ++i;
+        } else if (!strcmp(arg, "--threads") && next) {
+            threads = atoi(next);
+            ++i;
+        } else if (!strcmp(arg, "--mode") && next) {
+            mode = !strcmp(next, "twopass") ? LiquidSim::StepMode::TwoPass
+                                            : LiquidSim::StepMode::Fused;
+            ++i;
+        } else if (!strcmp(arg, "--boundary") && next) {
+            boundaryName = next;
+            if (!strcmp(next, "free"))
+                boundary = LiquidSim::Boundary::Free;
+            else if (!strcmp(next, "periodic"))
+                boundary = LiquidSim::Boundary::Periodic;
+            else if (!strcmp(next, "absorbing"))
+                boundary = LiquidSim::Boundary::Absorbing;
+            else
+                boundaryName = "fixed";
+            ++i;
+        } else if (!strcmp(arg, "--storage") && next) {
+            storageName = next;
+            if (!strcmp(next, "fp16"))
+                storage = LiquidSim::Storage::Half;
+            else if (!strcmp(next, "int16"))
+                storage = LiquidSim::Storage::Fixed16;
+            else
+                storageName = "fp32";
+            ++i;
+        } else if (!strcmp(arg, "--hugepages") && next) {
+            hugePagesName = next;
+            if (!strcmp(next, "thp"))
+                hugePages = HugePages::Transparent;
+            else if (!strcmp(next, "explicit"))
+                hugePages = HugePages::Explicit;
+            else
+                hugePagesName = "off";
+            ++i;
+        } else if (!strcmp(arg, "--idle") && next) {
+            idleSteps = atoi(next);
+            ++i;
+        } else if (!strcmp(arg, "--scalar")) {
+            scalar = true;
+        } else if (!strcmp(arg, "--dense")) {
+            dense = true;
+        } else if (!strcmp(arg, "--generic")) {
+            generic = true;
+        } else if (!strcmp(arg, "--no-temporal")) {
+            temporal = false;
+        } else if (!strcmp(arg, "--lut")) {
+            lut = true;
+        } else if (!strcmp(arg, "--upsample") && next) {
+            if (sscanf(next, "%dx%d", &outWidth, &outHeight) == 1)
+                outHeight = outWidth;
+            ++i;
+        } else if (!strcmp(arg, "--radius") && next) {
+            radius = atoi(next);
+            ++i;
+        } else if (!strcmp(arg, "--strokes")) {
+            strokes = true;
+        } else if (!strcmp(arg, "--env")) {
+            env = true;
+        } else {
+            fprintf(stderr, "unknown benchmark option: %s\n", arg);
+            return 1;
+        }
+    }
+    bool upsample = outWidth > 0 && outHeight > 0;
+    if (simWidth < 4 || simHeight < 4 || steps < 1 || substeps < 1) {
+        fprintf(stderr, "invalid benchmark size or step count\n");
+        return 1;
+    }
+
+    // Before any sim exists: the fields pick up the page mode, and the
+    // counters inherit into the pool threads.
+    SetHugePages(hugePages);
+    TlbMissCounter tlbLoads(false);
+    TlbMissCounter tlbStores(true);
+
+    LiquidSim sim(simWidth, simHeight, threads);
+    std::unique_ptr<LiquidSim> reference;
+    if (storage != LiquidSim::Storage::Float32)
+        reference.reset(new LiquidSim(simWidth, simHeight, threads));
+    for (LiquidSim *s : { &sim, reference.get() }) {
+        if (!s)
+            continue;
+        s->stepMode = mode;
+        s->boundary = boundary;
+        s->simdStep = !scalar;
+        s->simdShade = !scalar;
+        s->sparseTiles = !dense;
+        if (generic)
+            s->fusedRows = LiquidSim::FusedRowsGeneric;
+        s->temporalBlocking = temporal;
+        s->lutShade = lut;
+    }
+    sim.SetStorage(storage);
+    if (reference)
+        reference->sparseTiles = false; // packed grids step dense too
+    if (env) {
+        // Procedural 512x256 panorama so the textured path can be timed
+        // without image files: a sky-to-floor gradient with stripes.
+        std::vector<Rgba8> pano(512 * 256);
+        for (int y = 0; y < 256; ++y) {
+            for (int x = 0; x < 512; ++x) {
+                unsigned char stripe = ((x / 32) & 1) ? 40 : 0;
+                pano[y * 512 + x] = { (unsigned char)(255 - y / 2), (unsigned char)(200 - y / 2 + stripe),
+                                      (unsigned char)(y < 128 ? 255 : 90), 255 };
+            }
+        }
+        Environment environment;
+        environment.LoadEquirect({ pano.data(), 512, 256, 512 });
+        if (reference)
+            reference->SetEnvironment(environment);
+        sim.SetEnvironment(environment);
+    }
+
+    if (!upsample) {
+        outWidth = simWidth;
+        outHeight = simHeight;
+    }
+    std::vector<Rgba8> image((size_t)outWidth * outHeight, Rgba8{ 0, 0, 0, 255 });
+    RGBA8Span img = { image.data(), outWidth, outHeight, outWidth };
+    const float lightX = -0.4f;
+    const float lightY = -0.6f;
+
+    // Stroke script: a handful of pointers wandering across the surface,
+    // each lifting and landing again every 60 frames.
+    std::mt19937 rng(seed);
+    auto unit = [&rng]() { return (rng() >> 8) * (1.0f / 16777216.0f); };
+    const int pointers = 4;
+    float px[pointers], py[pointers], vx[pointers], vy[pointers];
+    for (int p = 0; p < pointers; ++p) {
+        px[p] = unit() * simWidth;
+        py[p] = unit() * simHeight;
+        vx[p] = (unit() - 0.5f) * 4.0f;
+        vy[p] = (unit() - 0.5f) * 4.0f;
+    }
+
+    // Input of the current frame, replayed on the reference after timing.
+    struct Input { float x0, y0, x1, y1; bool stroke; };
+    std::vector<Input> inputs;
+
+    BenchStats impulse, step, render;
+    impulse.samples.reserve(steps);
+    step.samples.reserve(steps);
+    render.samples.reserve(steps);
+
+    typedef std::chrono::steady_clock Clock;
+    for (int frame = 0; frame < steps; ++frame) {
+        inputs.clear();
+        Clock::time_point t0 = Clock::now();
+        for (int p = 0; p < pointers; ++p) {
+            if ((frame + p * 15) % 60 == 0) {
+                px[p] = unit() * simWidth;
+                py[p] = unit() * simHeight;
+                vx[p] = (unit() - 0.5f) * 4.0f;
+                vy[p] = (unit() - 0.5f) * 4.0f;
+            }
+            if ((frame + p * 15) % 60 >= 40)
+                continue; // pointer lifted
+            float fromX = px[p];
+            float fromY = py[p];
+            px[p] = std::fmod(px[p] + vx[p] + simWidth, (float)simWidth);
+            py[p] = std::fmod(py[p] + vy[p] + simHeight, (float)simHeight);
+            if (strokes) {
+                // Segments from the previous position; a wrap or a fresh
+                // landing starts a new stroke.
+                if ((frame + p * 15) % 60 == 0 || std::fabs(px[p] - fromX) > 8.0f ||
+                    std::fabs(py[p] - fromY) > 8.0f) {
+                    fromX = px[p];
+                    fromY = py[p];
+                }
+                sim.QueueStroke(fromX, fromY, px[p], py[p], -1.5f, radius);
+                if (reference)
+                    inputs.push_back({ fromX, fromY, px[p], py[p], true });
+                continue;
+            }
+            int ix = (int)px[p];
+            int iy = (int)py[p];
+            if (ix > 1 && ix < simWidth - 1 && iy > 1 && iy < simHeight - 1) {
+                sim.AddImpulse(ix, iy, -1.5f, radius);
+                if (reference)
+                    inputs.push_back({ (float)ix, (float)iy, 0.0f, 0.0f, false });
+            }
+        }
+        sim.FlushStrokes();
+        tlbLoads.Start();
+        tlbStores.Start();
+        Clock::time_point t1 = Clock::now();
+        sim.Advance(substeps);
+        Clock::time_point t2 = Clock::now();
+        tlbLoads.Stop();
+        tlbStores.Stop();
+        if (upsample)
+            sim.RenderUpsampled(img, lightX, lightY);
+        else
+            sim.RenderToImage(img, lightX, lightY);
+        Clock::time_point t3 = Clock::now();
+
+        impulse.samples.push_back(std::chrono::duration<double, std::nano>(t1 - t0).count());
+        step.samples.push_back(std::chrono::duration<double, std::nano>(t2 - t1).count());
+        render.samples.push_back(std::chrono::duration<double, std::nano>(t3 - t2).count());
+
+        if (reference) {
+            for (const Input &in : inputs) {
+                if (in.stroke)
+                    reference->QueueStroke(in.x0, in.y0, in.x1, in.y1, -1.5f, radius);
+                else
+                    reference->AddImpulse((int)in.x0, (int)in.y0, -1.5f, radius);
+            }
+            reference->FlushStrokes();
+            reference->Advance(substeps);
+        }
+    }
+
+    sim.SyncHeights();
+    double checksum = 0.0;
+    for (float h : sim.heightField)
+        checksum += h;
+    uint32_t imageHash = 2166136261u; // FNV-1a over the pixel bytes
+    for (const Rgba8 &p : image) {
+        for (unsigned char c : { p.r, p.g, p.b, p.a })
+            imageHash = (imageHash ^ c) * 16777619u;
+    }
+
+    printf("mLiquidMetal benchmark: %dx%d, %d frames x %d substeps, seed %u\n",
+           simWidth, simHeight, steps, substeps, seed);
+    printf("kernel: %s %s%s, %d threads, %s walls, %s storage, sparse %s, temporal %s, shading %s%s\n",
+           mode == LiquidSim::StepMode::Fused ? "fused" : "two-pass",
+           scalar ? "scalar" : LiquidSim::SimdName(),
+           sim.fusedRows == LiquidSim::FusedRowsGeneric ? "" : " fixed-width", sim.ThreadCount(),
+           boundaryName, storageName,
+           sim.UsesSparseTiles() ? "on" : "off", sim.UsesTemporalBlocking() ? "on" : "off", sim.UsesShadeLut() ? "lut" : "exact",
+           env ? ", textured environment" : "");
+    printf("kernel variants:");
+    for (int i = 0; i < KernelVariantCount(); ++i)
+        printf(" %s%s", KernelVariantName(i), KernelVariantSupported(i) ? "" : " (unsupported)");
+    printf("\n");
+    if (upsample)
+        printf("render: upsampled to %dx%d (ns per output pixel)\n", outWidth, outHeight);
+    printf("%-8s %12s %12s %12s   (ns/cell)\n", "phase", "min", "median", "p99");
+    double cells = (double)simWidth * simHeight;
+    impulse.Print("impulse", cells);
+    step.Print("step", cells);
+    render.Print("render", (double)outWidth * outHeight);
+    printf("median frame: %.3f ms\n", MedianFrameNs(impulse, step, render) * 1e-6);
+    printf("height checksum: %.9g\n", checksum);
+    printf("image checksum: %08x\n", imageHash);
+
+    double thpMb, hugetlbMb;
+    HugePageUsage(thpMb, hugetlbMb);
+    printf("huge pages: %s, %.0f MB transparent, %.0f MB hugetlb\n", hugePagesName, thpMb, hugetlbMb);
+    if (tlbLoads.Available() && tlbStores.Available()) {
+        double totalSteps = (double)steps * substeps;
+        printf("step dTLB misses: %.0f loads, %.0f stores per step (%.3f per 1k cells)\n",
+               tlbLoads.Read() / totalSteps, tlbStores.Read() / totalSteps,
+               (tlbLoads.Read() + tlbStores.Read()) / totalSteps / cells * 1000.0);
+    } else {
+        printf("step dTLB misses: unavailable (perf events not permitted)\n");
+    }
+
+    if (reference) {
+        // Heights over the interior, then the final image against a full
+        // render of the reference.
+        auto maxHeight = [](const LiquidSim &s) {
+            float m = 0.0f;
+            for (int y = 1; y < s.height - 1; ++y)
+                for (int x = 1; x < s.width - 1; ++x)
+                    m = std::max(m, std::fabs(s.heightField[s.idx(x, y)]));
+            return m;
+        };
+        double maxDiff = 0.0;
+        double sumSq = 0.0;
+        for (int y = 1; y < simHeight - 1; ++y) {
+            for (int x = 1; x < simWidth - 1; ++x) {
+                double d = sim.heightField[sim.idx(x, y)] - reference->heightField[sim.idx(x, y)];
+                maxDiff = std::max(maxDiff, std::fabs(d));
+                sumSq += d * d;
+            }
+        }
+        std::vector<Rgba8> refImage(image.size(), Rgba8{ 0, 0, 0, 255 });
+        RGBA8Span refImg = { refImage.data(), outWidth, outHeight, outWidth };
+        if (upsample)
+            reference->RenderUpsampled(refImg, lightX, lightY);
+        else
+            reference->RenderToImage(refImg, lightX, lightY);
+        int maxChannel = 0;
+        size_t differing = 0;
+        for (size_t i = 0; i < image.size(); ++i) {
+            int d = std::max({ std::abs(image[i].r - refImage[i].r), std::abs(image[i].g - refImage[i].g),
+                               std::abs(image[i].b - refImage[i].b) });
+            maxChannel = std::max(maxChannel, d);
+            differing += d > 0;
+        }
+        printf("storage %s vs fp32: max |dh| %.3g, rms %.3g (max |h| %.3g)\n", storageName,
+               maxDiff, std::sqrt(sumSq / ((double)(simWidth - 2) * (simHeight - 2))),
+               maxHeight(*reference));
+        printf("image vs fp32: max channel diff %d, %.3f%% of pixels differ\n", maxChannel,
+               100.0 * differing / image.size());
+
+        if (idleSteps > 0) {
+            sim.Advance(idleSteps);
+            reference->Advance(idleSteps);
+            sim.SyncHeights();
+            printf("after %d idle steps: max |h| %.3g %s, %.3g fp32\n", idleSteps,
+                   maxHeight(sim), storageName, maxHeight(*reference));
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,195 @@
+#include "environment.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// For each face: the direction components that become u and v, and their
+// signs (u = sign * d[axis] / |major| mapped from [-1, 1] to [0, 1]).
+const int kFaceU[6] = { 2, 2, 0, 0, 0, 0 };
+const int kFaceV[6] = { 1, 1, 2, 2, 1, 1 };
+const float kFaceUSign[6] = { -1.0f, 1.0f, 1.0f, 1.0f, 1.0f, -1.0f };
+const float kFaceVSign[6] = { -1.0f, -1.0f, 1.0f, -1.0f, -1.0f, -1.0f };
+
+const float kPi = 3.14159265358979f;
+
+unsigned char ToByte(float v) {
+    return (unsigned char)std::min(std::max(v + 0.5f, 0.0f), 255.0f);
+}
+
+// Bilinear filter of the four texels at (x0, y0) - (x1, y1).
+void Blend(RGBA8View img, int x0, int y0, int x1, int y1, float fx, float fy, float rgb[3]) {
+    const Rgba8 &a = img.pixels[(size_t)y0 * img.pitch + x0];
+    const Rgba8 &b = img.pixels[(size_t)y0 * img.pitch + x1];
+    const Rgba8 &c = img.pixels[(size_t)y1 * img.pitch + x0];
+    const Rgba8 &d = img.pixels[(size_t)y1 * img.pitch + x1];
+    float wa = (1.0f - fx) * (1.0f - fy);
+    float wb = fx * (1.0f - fy);
+    float wc = (1.0f - fx) * fy;
+    float wd = fx * fy;
+    rgb[0] = a.r * wa + b.r * wb + c.r * wc + d.r * wd;
+    rgb[1] = a.g * wa + b.g * wb + c.g * wc + d.g * wd;
+    rgb[2] = a.b * wa + b.b * wb + c.b * wc + d.b * wd;
+}
+
+// Bilinear, clamped at the edges. Only clamps (min / max), no branches:
+// this is the per-pixel face lookup.
+void SampleImage(RGBA8View img, float u, float v, float rgb[3]) {
+    float px = std::min(std::max(u * img.width - 0.5f, 0.0f), (float)(img.width - 1));
+    float py = std::min(std::max(v * img.height - 0.5f, 0.0f), (float)(img.height - 1));
+    int x0 = (int)px;
+    int y0 = (int)py;
+    int x1 = std::min(x0 + 1, img.width - 1);
+    int y1 = std::min(y0 + 1, img.height - 1);
+    Blend(img, x0, y0, x1, y1, px - x0, py - y0, rgb);
+}
+
+// Bilinear, u wrapping around and v clamped; for panoramas.
+void SampleImageWrapped(RGBA8View img, float u, float v, float rgb[3]) {
+    float px = u * img.width - 0.5f;
+    float py = std::min(std::max(v * img.height - 0.5f, 0.0f), (float)(img.height - 1));
+    float fx0 = std::floor(px);
+    int x0 = (((int)fx0 % img.width) + img.width) % img.width;
+    int y0 = (int)py;
+    int x1 = (x0 + 1) % img.width;
+    int y1 = std::min(y0 + 1, img.height - 1);
+    Blend(img, x0, y0, x1, y1, px - fx0, py - y0, rgb);
+}
+
+} // namespace
+
+Environment Environment::FromFaceColors(const Rgba8 colors[6]) {
+    Environment env;
+    env.faceSize = 1;
+    env.texels.assign(colors, colors + 6);
+    env.BuildMips();
+    return env;
+}
+
+bool Environment::LoadFaces(const RGBA8View faces[6]) {
+    int size = faces[0].width;
+    for (int f = 0; f < 6; ++f) {
+        if (!faces[f].pixels || faces[f].width != size || faces[f].height != size || size < 1)
+            return false;
+    }
+
+    faceSize = size;
+    texels.resize((size_t)6 * size * size);
+    for (int f = 0; f < 6; ++f) {
+        for (int y = 0; y < size; ++y)
+            std::copy(faces[f].pixels + (size_t)y * faces[f].pitch,
+                      faces[f].pixels + (size_t)y * faces[f].pitch + size,
+                      texels.begin() + ((size_t)f * size + y) * size);
+    }
+    BuildMips();
+    return true;
+}
+
+bool Environment::LoadEquirect(RGBA8View image, int size) {
+    if (!image.pixels || image.width < 1 || image.height < 1)
+        return false;
+    if (size <= 0)
+        size = std::max(1, image.width / 4);
+
+    faceSize = size;
+    texels.resize((size_t)6 * size * size);
+    for (int f = 0; f < 6; ++f) {
+        int axis = f / 2;
+        float sign = (f & 1) ? -1.0f : 1.0f;
+        for (int y = 0; y < size; ++y) {
+            for (int x = 0; x < size; ++x) {
+                float d[3] = {};
+                d[axis] = sign;
+                d[kFaceU[f]] = ((x + 0.5f) / size * 2.0f - 1.0f) * kFaceUSign[f];
+                d[kFaceV[f]] = ((y + 0.5f) / size * 2.0f - 1.0f) * kFaceVSign[f];
+                float len = std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+
+                float u = 0.5f + std::atan2(d[0], d[2]) / (2.0f * kPi);
+                float v = std::acos(std::min(std::max(-d[1] / len, -1.0f), 1.0f)) / kPi;
+                float rgb[3];
+                SampleImageWrapped(image, u, v, rgb);
+                texels[((size_t)f * size + y) * size + x] =
+                    { ToByte(rgb[0]), ToByte(rgb[1]), ToByte(rgb[2]), 255 };
+            }
+        }
+    }
+    BuildMips();
+    return true;
+}
+
+void Environment::BuildMips() {
+    levels = 1;
+    for (int s = faceSize; s > 1; s /= 2)
+        ++levels;
+
+    levelOffset.assign(1, 0);
+    size_t total = (size_t)6 * faceSize * faceSize;
+    for (int l = 1; l < levels; ++l) {
+        levelOffset.push_back(total);
+        int s = faceSize >> l;
+        total += (size_t)6 * s * s;
+    }
+    texels.resize(total);
+
+    for (int l = 1; l < levels; ++l) {
+        int src = faceSize >> (l - 1);
+        int dst = faceSize >> l;
+        for (int f = 0; f < 6; ++f) {
+            const Rgba8 *in = Face(l - 1, f);
+            Rgba8 *out = texels.data() + levelOffset[l] + (size_t)f * dst * dst;
+            for (int y = 0; y < dst; ++y) {
+                for (int x = 0; x < dst; ++x) {
+                    const Rgba8 &a = in[(size_t)(2 * y) * src + 2 * x];
+                    const Rgba8 &b = in[(size_t)(2 * y) * src + 2 * x + 1];
+                    const Rgba8 &c = in[(size_t)(2 * y + 1) * src + 2 * x];
+                    const Rgba8 &d = in[(size_t)(2 * y + 1) * src + 2 * x + 1];
+                    out[(size_t)y * dst + x] = {
+                        (unsigned char)((a.r + b.r + c.r + d.r + 2) / 4),
+                        (unsigned char)((a.g + b.g + c.g + d.g + 2) / 4),
+                        (unsigned char)((a.b + b.b + c.b + d.b + 2) / 4),
+                        (unsigned char)((a.a + b.a + c.a + d.a + 2) / 4),
+                    };
+                }
+            }
+        }
+    }
+}
+
+void Environment::SampleFace(int level, int face, float u, float v, float rgb[3]) const {
+    int s = faceSize >> level;
+    RGBA8View view = { Face(level, face), s, s, s };
+    SampleImage(view, u, v, rgb);
+}
+
+Rgba8 Environment::Sample(float x, float y, float z, float lod) const {
+    const float d[3] = { x, y, z };
+    const float a[3] = { std::fabs(x), std::fabs(y), std::fabs(z) };
+
+    // Dominant axis with the same tie-breaking as the original flat
+    // cubemap: X only if strictly largest, then Y over Z, negative on <= 0.
+    int xMajor = (a[0] > a[1]) & (a[0] > a[2]);
+    int yMajor = !xMajor & (a[1] > a[2]);
+    int axis = yMajor + 2 * (!xMajor & !yMajor);
+    int face = axis * 2 + (d[axis] <= 0.0f);
+
+    float inv = 0.5f / std::max(a[axis], 1e-20f);
+    float u = d[kFaceU[face]] * kFaceUSign[face] * inv + 0.5f;
+    float v = d[kFaceV[face]] * kFaceVSign[face] * inv + 0.5f;
+
+    // Both neighbouring levels are always read (the same one twice at the
+    // last level), so the lookup does not branch on lod either; with
+    // t = 0 the blend returns the first level exactly.
+    float level = std::min(std::max(lod, 0.0f), (float)(levels - 1));
+    int l0 = (int)level;
+    int l1 = std::min(l0 + 1, levels - 1);
+    float t = level - l0;
+
+    float rgb[3];
+    float next[3];
+    SampleFace(l0, face, u, v, rgb);
+    SampleFace(l1, face, u, v, next);
+    for (int c = 0; c < 3; ++c)
+        rgb[c] += (next[c] - rgb[c]) * t;
+    return { ToByte(rgb[0]), ToByte(rgb[1]), ToByte(rgb[2]), 255 };
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "rgba8.h"
+
+// Cubemap environment for the chrome reflections.
+//
+// All six faces of every mip level live in one RGBA8 array: level-major,
+// then face (+X, -X, +Y, -Y, +Z, -Z), then rows. Face orientation follows
+// the OpenGL cubemap convention. Each level halves the face size down to
+// 1x1 with a 2x2 box filter per face (seams are not filtered across faces),
+// so larger lods give the blurred look of a rougher surface.
+//
+// Sample() picks the face and UV without branches (the face comes from
+// comparisons, the UV axes from small tables) and filters bilinearly,
+// plus linearly between the two nearest levels, with clamps instead of
+// tests, so its cost does not depend on the direction or the lod.
+struct Environment {
+    int faceSize = 0;
+    int levels = 0;
+    std::vector<Rgba8> texels;
+    std::vector<size_t> levelOffset;
+
+    // One flat colour per face: the original look.
+    static Environment FromFaceColors(const Rgba8 colors[6]);
+
+    // Six square faces of equal size in face order. Returns false (and
+    // leaves the environment unchanged) if the sizes do not match.
+    bool LoadFaces(const RGBA8View faces[6]);
+
+    // Latitude-longitude panorama, resampled into faces of faceSize
+    // (0 picks width / 4). The centre of the image faces the viewer (+Z)
+    // and its top row is the -Y pole.
+    bool LoadEquirect(RGBA8View image, int faceSize = 0);
+
+    bool IsFlat() const { return faceSize == 1; }
+
+    // Colour seen in direction (x, y, z), which need not be normalized.
+    // lod is clamped to [0, levels - 1].
+    Rgba8 Sample(float x, float y, float z, float lod = 0.0f) const;
+
+    // Bilinear lookup at face coordinates u, v in [0, 1].
+    void SampleFace(int level, int face, float u, float v, float rgb[3]) const;
+
+    const Rgba8 *Face(int level, int face) const {
+        int s = faceSize >> level;
+        return texels.data() + levelOffset[level] + (size_t)face * s * s;
+    }
+
+    void BuildMips();
+};
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+// Per-frame stage timings for the GUI.
+//
+// The main thread opens a frame with BeginFrame(), wraps each stage in a
+// Scope, and the finished record is published to a fixed-size ring when
+// the next frame begins. Recording never locks or allocates: a record is
+// written into its slot and made visible with one release store of the
+// frame counter. Readers get the newest kCapacity frames; a reader on
+// another thread must finish copying a record before the producer laps it.
+enum class ProfileStage : int {
+    Input,
+    Impulse,
+    Step,
+    Render,
+    Upload,
+    Draw,
+    Present, // EndDrawing(): buffer swap plus frame pacing wait
+    Count
+};
+
+inline const char *ProfileStageName(ProfileStage stage) {
+    static const char *names[] = { "input", "impulse", "step", "render", "upload", "draw", "present" };
+    return names[(int)stage];
+}
+
+struct FrameRecord {
+    uint64_t frame = 0;
+    float frameMs = 0.0f;
+    float stageMs[(int)ProfileStage::Count] = {};
+};
+
+class FrameProfiler {
+public:
+    static constexpr int kCapacity = 1024;
+
+    typedef std::chrono::steady_clock Clock;
+
+    // Adds the time until End() (or destruction) to a stage of the open
+    // frame. End() lets straight-line code close a stage without a block.
+    class Scope {
+    public:
+        Scope(FrameProfiler &profiler, ProfileStage stage)
+            : profiler(profiler), stage(stage), start(Clock::now()) {}
+        ~Scope() { End(); }
+
+        void End() {
+            if (!running)
+                return;
+            std::chrono::duration<float, std::milli> ms = Clock::now() - start;
+            profiler.current.stageMs[(int)stage] += ms.count();
+            running = false;
+        }
+
+    private:
+        FrameProfiler &profiler;
+        ProfileStage stage;
+        Clock::time_point start;
+        bool running = true;
+    };
+
+    // Publishes the previous frame (if any) and starts timing a new one.
+    void BeginFrame() {
+        Clock::time_point now = Clock::now();
+        if (frameOpen) {
+            current.frameMs = std::chrono::duration<float, std::milli>(now - frameStart).count();
+            uint64_t n = published.load(std::memory_order_relaxed);
+            current.frame = n;
+            ring[n % kCapacity] = current;
+            published.store(n + 1, std::memory_order_release);
+        }
+        current = FrameRecord();
+        frameStart = now;
+        frameOpen = true;
+    }
+
+    // Number of frames published so far; the ring holds the newest
+    // min(Count(), kCapacity) of them.
+    uint64_t Count() const { return published.load(std::memory_order_acquire); }
+
+    // ago = 0 is the most recently published frame.
+    const FrameRecord &Recent(int ago) const {
+        return ring[(Count() - 1 - ago) % kCapacity];
+    }
+
+    int Available() const {
+        uint64_t n = Count();
+        return n < (uint64_t)kCapacity ? (int)n : kCapacity;
+    }
+
+    float AverageStageMs(ProfileStage stage, int frames) const {
+        frames = frames < Available() ? frames : Available();
+        float sum = 0.0f;
+        for (int i = 0; i < frames; ++i)
+            sum += Recent(i).stageMs[(int)stage];
+        return frames > 0 ? sum / frames : 0.0f;
+    }
+
+    float AverageFrameMs(int frames) const {
+        frames = frames < Available() ? frames : Available();
+        float sum = 0.0f;
+        for (int i = 0; i < frames; ++i)
+            sum += Recent(i).frameMs;
+        return frames > 0 ? sum / frames : 0.0f;
+    }
+
+    // Writes every frame still in the ring, oldest first.
+    bool WriteCsv(const char *path) const {
+        FILE *f = fopen(path, "w");
+        if (!f)
+            return false;
+        fprintf(f, "frame,frame_ms");
+        for (int s = 0; s < (int)ProfileStage::Count; ++s)
+            fprintf(f, ",%s_ms", ProfileStageName((ProfileStage)s));
+        fprintf(f, "\n");
+        for (int i = Available() - 1; i >= 0; --i) {
+            const FrameRecord &r = Recent(i);
+            fprintf(f, "%llu,%.4f", (unsigned long long)r.frame, r.frameMs);
+            for (int s = 0; s < (int)ProfileStage::Count; ++s)
+                fprintf(f, ",%.4f", r.stageMs[s]);
+            fprintf(f, "\n");
+        }
+        return fclose(f) == 0;
+    }
+
+private:
+    FrameRecord ring[kCapacity];
+    std::atomic<uint64_t> published{ 0 };
+    FrameRecord current;
+    Clock::time_point frameStart;
+    bool frameOpen = false;
+};
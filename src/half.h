@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+// IEEE binary16 <-> binary32 conversions with round-to-nearest-even,
+// matching the F16C instructions bit for bit (subnormals, infinities and
+// NaNs included). Used where F16C is not available.
+//
+// Internal linkage: the SIMD kernels are built once per instruction set
+// (see simd.h), and each build must keep its own copy.
+
+// One binary16 value by its bit pattern; names the type where a plain
+// uint16_t would not say what the bits mean (LiquidSimFixed's storage).
+struct Float16 {
+    uint16_t bits;
+};
+
+static inline uint16_t FloatToHalf(float f) {
+    uint32_t x;
+    std::memcpy(&x, &f, sizeof(x));
+    uint16_t sign = (uint16_t)((x >> 16) & 0x8000);
+    uint32_t a = x & 0x7fffffff;
+
+    if (a >= 0x7f800000) // infinity or NaN (kept quiet)
+        return sign | 0x7c00 | (a > 0x7f800000 ? 0x200 | ((a >> 13) & 0x3ff) : 0);
+    if (a >= 0x477ff000) // rounds past 65504
+        return sign | 0x7c00;
+    if (a < 0x38800000) {
+        // Subnormal half: round(|f| * 2^24). Below 2^-25 that is zero.
+        if (a < 0x33000000)
+            return sign;
+        uint32_t mant = (a & 0x7fffff) | 0x800000;
+        int shift = 126 - (int)(a >> 23);
+        uint32_t r = mant >> shift;
+        uint32_t rem = mant & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (rem > halfway || (rem == halfway && (r & 1)))
+            ++r;
+        return sign | (uint16_t)r;
+    }
+
+    // Normal: rebias the exponent and round off 13 mantissa bits; a carry
+    // out of the mantissa correctly bumps the exponent.
+    uint32_t r = (a - 0x38000000) >> 13;
+    uint32_t rem = a & 0x1fff;
+    if (rem > 0x1000 || (rem == 0x1000 && (r & 1)))
+        ++r;
+    return sign | (uint16_t)r;
+}
+
+static inline float HalfToFloat(uint16_t h) {
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    uint32_t exp = (h >> 10) & 0x1f;
+    uint32_t mant = h & 0x3ff;
+    uint32_t x;
+    if (exp == 0x1f) {
+        x = sign | 0x7f800000 | (mant << 13) | (mant ? 0x400000 : 0);
+    } else if (exp != 0) {
+        x = sign | ((exp + 112) << 23) | (mant << 13);
+    } else {
+        float f = (float)mant * (1.0f / 16777216.0f);
+        std::memcpy(&x, &f, sizeof(x));
+        x |= sign;
+    }
+    float f;
+    std::memcpy(&f, &x, sizeof(f));
+    return f;
+}
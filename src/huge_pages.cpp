@@ -0,0 +1,88 @@
+#include "huge_pages.h"
+
+#include <atomic>
+#include <cstdint>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+namespace {
+
+std::atomic<HugePages> hugePages{ HugePages::Off };
+
+#if defined(__linux__)
+// Successive blocks start a few cache lines further into their first huge
+// page. Left 2 MB aligned, the fields a step streams side by side would
+// all map the same cell to the same cache sets, which halved the dense
+// step's speed.
+constexpr size_t staggerStep = 17 * hugePageBlockAlignment;
+constexpr size_t staggerCount = 8;
+std::atomic<unsigned> staggerNext{ 0 };
+
+size_t MappedLength(size_t bytes) {
+    bytes += staggerStep * (staggerCount - 1);
+    return (bytes + hugePageSize - 1) & ~(hugePageSize - 1);
+}
+
+void *Stagger(void *base) {
+    unsigned i = staggerNext.fetch_add(1, std::memory_order_relaxed) % staggerCount;
+    return (char *)base + i * staggerStep;
+}
+#endif
+
+} // namespace
+
+void SetHugePages(HugePages mode) {
+    hugePages.store(mode, std::memory_order_relaxed);
+}
+
+HugePages GetHugePages() {
+    return hugePages.load(std::memory_order_relaxed);
+}
+
+#if defined(__linux__)
+
+void *AllocateHugePages(size_t bytes) {
+    const HugePages mode = GetHugePages();
+    const size_t length = MappedLength(bytes);
+    if (mode == HugePages::Explicit) {
+        void *p = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED)
+            return Stagger(p);
+    }
+
+    // Map one huge page more than needed and trim both ends, so the block
+    // starts on a 2 MB boundary and every page of it can be a huge one.
+    void *raw = mmap(nullptr, length + hugePageSize, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED)
+        throw std::bad_alloc();
+    uintptr_t start = ((uintptr_t)raw + hugePageSize - 1) & ~(uintptr_t)(hugePageSize - 1);
+    size_t head = start - (uintptr_t)raw;
+    if (head > 0)
+        munmap(raw, head);
+    if (hugePageSize - head > 0)
+        munmap((char *)start + length, hugePageSize - head);
+    if (mode != HugePages::Off)
+        madvise((void *)start, length, MADV_HUGEPAGE);
+    return Stagger((void *)start);
+}
+
+void FreeHugePages(void *p, size_t bytes) {
+    uintptr_t base = (uintptr_t)p & ~(uintptr_t)(hugePageSize - 1);
+    munmap((void *)base, MappedLength(bytes));
+}
+
+#else
+
+void *AllocateHugePages(size_t bytes) {
+    return ::operator new(bytes, std::align_val_t(4096));
+}
+
+void FreeHugePages(void *p, size_t) {
+    ::operator delete(p, std::align_val_t(4096));
+}
+
+#endif
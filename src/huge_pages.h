@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+
+// Page backing for the large solver buffers (the LiquidSim fields and
+// pipeline snapshots). A 4096^2 float field spans 16384 4 KB pages but
+// only 32 2 MB ones, so a dense step that streams several fields stops
+// thrashing the TLB once they sit on huge pages.
+//
+//   Off          no advice: the kernel's default (on most distributions
+//                small pages unless transparent huge pages are "always").
+//   Transparent  madvise(MADV_HUGEPAGE) on 2 MB aligned mappings, so the
+//                kernel backs them with 2 MB pages when it can. Needs no
+//                setup beyond THP being "madvise" or "always".
+//   Explicit     MAP_HUGETLB pages from the reserved pool (vm.nr_hugepages);
+//                falls back to Transparent when the pool is too small.
+//
+// Only Linux honours the mode. There, allocations of at least
+// hugePageSize bytes are always separate 2 MB aligned mappings, rounded up
+// to whole huge pages, so they can be freed whatever the mode is by then.
+// Smaller ones, and every allocation elsewhere, come from the heap. The
+// mode is process-wide and applies to buffers allocated after it is set:
+// set it before constructing the sims.
+enum class HugePages { Off, Transparent, Explicit };
+constexpr size_t hugePageSize = size_t(2) << 20;
+// Alignment of the blocks AllocateHugePages() returns: mappings are
+// staggered by multiples of a cache line (see huge_pages.cpp), so they are
+// not page aligned.
+constexpr size_t hugePageBlockAlignment = 64;
+
+void SetHugePages(HugePages mode);
+HugePages GetHugePages();
+
+// For bytes >= hugePageSize; throws std::bad_alloc on failure.
+void *AllocateHugePages(size_t bytes);
+void FreeHugePages(void *p, size_t bytes);
+
+// Allocator for std::vector that aligns the storage to Align bytes, e.g.
+// to a cache line so rows with a matching pitch start on one, and sends
+// allocations of at least hugePageSize bytes through AllocateHugePages().
+template <typename T, size_t Align>
+struct HugePageAllocator {
+    static_assert(Align <= hugePageBlockAlignment, "huge page blocks are staggered by whole cache lines only");
+    typedef T value_type;
+
+    template <typename U>
+    struct rebind { typedef HugePageAllocator<U, Align> other; };
+
+    HugePageAllocator() = default;
+    template <typename U>
+    HugePageAllocator(const HugePageAllocator<U, Align> &) {}
+
+    T *allocate(size_t n) {
+        if (n * sizeof(T) >= hugePageSize)
+            return static_cast<T *>(AllocateHugePages(n * sizeof(T)));
+        return static_cast<T *>(::operator new(n * sizeof(T), std::align_val_t(Align)));
+    }
+    void deallocate(T *p, size_t n) {
+        if (n * sizeof(T) >= hugePageSize)
+            FreeHugePages(p, n * sizeof(T));
+        else
+            ::operator delete(p, std::align_val_t(Align));
+    }
+
+    template <typename U>
+    bool operator==(const HugePageAllocator<U, Align> &) const { return true; }
+    template <typename U>
+    bool operator!=(const HugePageAllocator<U, Align> &) const { return false; }
+};
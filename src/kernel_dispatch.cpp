@@ -0,0 +1,143 @@
+#include "sim_kernels.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define MLM_X86 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace {
+
+struct CpuFeatures {
+    bool sse42 = false;
+    bool avx2 = false;    // AVX2 and F16C, with the OS saving ymm state
+    bool avx512 = false;  // AVX-512 F, VL, BW and DQ, with zmm state saved
+};
+
+#if defined(MLM_X86)
+void Cpuid(unsigned leaf, unsigned sub, unsigned r[4]) {
+#if defined(_MSC_VER)
+    int v[4];
+    __cpuidex(v, (int)leaf, (int)sub);
+    for (int i = 0; i < 4; ++i)
+        r[i] = (unsigned)v[i];
+#else
+    __cpuid_count(leaf, sub, r[0], r[1], r[2], r[3]);
+#endif
+}
+
+uint64_t EnabledStateMask() {
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    uint32_t lo, hi;
+    __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return ((uint64_t)hi << 32) | lo;
+#endif
+}
+#endif
+
+CpuFeatures DetectCpu() {
+    CpuFeatures f;
+#if defined(MLM_X86)
+    unsigned r[4];
+    Cpuid(0, 0, r);
+    const unsigned maxLeaf = r[0];
+    if (maxLeaf < 1)
+        return f;
+    Cpuid(1, 0, r);
+    const unsigned ecx1 = r[2];
+    f.sse42 = (ecx1 & (1u << 19)) && (ecx1 & (1u << 20));
+    const bool osxsave = ecx1 & (1u << 27);
+    const bool avx = ecx1 & (1u << 28);
+    const bool f16c = ecx1 & (1u << 29);
+    if (maxLeaf < 7 || !osxsave || !avx)
+        return f;
+
+    // xmm/ymm state (bits 1, 2), plus opmask and zmm state (5-7).
+    const uint64_t state = EnabledStateMask();
+    const bool ymm = (state & 0x6) == 0x6;
+    const bool zmm = (state & 0xe6) == 0xe6;
+    Cpuid(7, 0, r);
+    const unsigned ebx7 = r[1];
+    f.avx2 = ymm && f16c && (ebx7 & (1u << 5));
+    const unsigned avx512Bits = (1u << 16) | (1u << 17) | (1u << 30) | (1u << 31); // F, DQ, BW, VL
+    f.avx512 = f.avx2 && zmm && (ebx7 & avx512Bits) == avx512Bits;
+#endif
+    return f;
+}
+
+struct Variant {
+    const char *name;
+    const SimKernels &(*table)();
+    bool supported;
+};
+
+// Built variants, worst first. The scalar one is always built.
+const Variant *Variants(int &count) {
+    static const CpuFeatures cpu = DetectCpu();
+    static const Variant variants[] = {
+        { "scalar", SimKernelsScalar, true },
+#if defined(MLM_HAVE_KERNELS_SSE42)
+        { "sse4.2", SimKernelsSse42, cpu.sse42 },
+#endif
+#if defined(MLM_HAVE_KERNELS_AVX2)
+        { "avx2", SimKernelsAvx2, cpu.avx2 },
+#endif
+#if defined(MLM_HAVE_KERNELS_AVX512)
+        { "avx512", SimKernelsAvx512, cpu.avx512 },
+#endif
+    };
+    count = (int)(sizeof(variants) / sizeof(variants[0]));
+    return variants;
+}
+
+const SimKernels &SelectKernels() {
+    int count;
+    const Variant *variants = Variants(count);
+    const char *forced = std::getenv("MLIQUIDMETAL_KERNELS");
+    if (forced && *forced) {
+        for (int i = 0; i < count; ++i) {
+            if (!std::strcmp(forced, variants[i].name) && variants[i].supported)
+                return variants[i].table();
+        }
+        std::fprintf(stderr, "MLIQUIDMETAL_KERNELS=%s is not built or not supported by this CPU; "
+                             "using the best available kernels\n", forced);
+    }
+    for (int i = count - 1; i > 0; --i) {
+        if (variants[i].supported)
+            return variants[i].table();
+    }
+    return variants[0].table();
+}
+
+} // namespace
+
+const SimKernels &ActiveKernels() {
+    static const SimKernels &kernels = SelectKernels();
+    return kernels;
+}
+
+int KernelVariantCount() {
+    int count;
+    Variants(count);
+    return count;
+}
+
+const char *KernelVariantName(int i) {
+    int count;
+    return Variants(count)[i].name;
+}
+
+bool KernelVariantSupported(int i) {
+    int count;
+    return Variants(count)[i].supported;
+}
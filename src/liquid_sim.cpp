@@ -0,0 +1,1299 @@
+#include "liquid_sim.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <utility>
+
+#include "sim_kernels.h"
+#include "thread_pool.h"
+
+namespace {
+
+// One row of the fused integrator: reads heights from the previous
+// buffer (rows hN, hC, hS), updates velocity in place and writes the new
+// heights to out. Per cell this is exactly the two-pass sequence
+//   v = (v + (sum - 4c) * k) * 0.94;  h' = c + v
+// so both modes produce identical fields. This is the scalar reference;
+// SimKernels::fusedRow is the vector version.
+inline void StepFusedRow(const float *hN, const float *hC, const float *hS,
+                         float *v, float *out, int x0, int x1, float k) {
+    for (int x = x0; x < x1; ++x) {
+        float sum = hC[x - 1] + hC[x + 1] + hN[x] + hS[x];
+        float vel = (v[x] + (sum - 4.0f * hC[x]) * k) * 0.94f;
+        v[x] = vel;
+        out[x] = hC[x] + vel;
+    }
+}
+
+void FusedRowsScalar(const float *h, float *v, float *out, int pitch, int y0, int y1, float k) {
+    for (int y = y0; y < y1; ++y) {
+        size_t row = (size_t)y * pitch;
+        StepFusedRow(h + row - pitch, h + row, h + row + pitch, v + row, out + row, 0, pitch, k);
+    }
+}
+
+// Ghost columns and padding of rows [y0, y1) for fp32 or packed planes.
+// Ghosts are bit copies and zero is all-zero bits in every storage, so one
+// version serves all of them. Ghost velocities are never read and stay
+// zero, and the padding is cleared so it never decays into denormals.
+template <typename T>
+void GhostColumns(const LiquidSim &sim, T *h, T *v, int firstRow, int y0, int y1) {
+    typedef LiquidSim::Boundary Boundary;
+    const int width = sim.width;
+    const int pitch = sim.pitch;
+    for (int y = y0; y < y1; ++y) {
+        T *hr = h + (size_t)(y - firstRow) * pitch;
+        T *vr = v + (size_t)(y - firstRow) * pitch;
+        T left = 0;
+        T right = 0;
+        if (sim.boundary == Boundary::Free || sim.boundary == Boundary::Absorbing) {
+            left = hr[1];
+            right = hr[width - 2];
+        } else if (sim.boundary == Boundary::Periodic) {
+            left = hr[width - 2];
+            right = hr[1];
+        }
+        hr[0] = left;
+        vr[0] = 0;
+        hr[width - 1] = right;
+        std::fill(hr + width, hr + pitch, T(0));
+        std::fill(vr + width - 1, vr + pitch, T(0));
+    }
+}
+
+template <typename T>
+void GhostRows(const LiquidSim &sim, T *h, int firstRow, int lastRow) {
+    typedef LiquidSim::Boundary Boundary;
+    const int height = sim.height;
+    if (sim.boundary == Boundary::Fixed)
+        return;
+    auto row = [&](int y) { return h + (size_t)(y - firstRow) * sim.pitch; };
+    if (sim.boundary == Boundary::Periodic) {
+        if (firstRow == 0 && lastRow == height) {
+            std::copy(row(height - 2), row(height - 1), row(0));
+            std::copy(row(1), row(2), row(height - 1));
+        }
+        return;
+    }
+    if (firstRow == 0 && lastRow > 1)
+        std::copy(row(1), row(2), row(0));
+    if (lastRow == height && firstRow < height - 2)
+        std::copy(row(height - 2), row(height - 1), row(height - 1));
+}
+
+// Calls fn(y, rowScale, a, b) for each run [a, b) of row y inside
+// [x0, x1) x [y0, y1) that the sponge touches: whole rows in the top and
+// bottom bands, only the left and right bands elsewhere.
+template <typename Fn>
+void ForSpongeSegments(const LiquidSim &sim, int x0, int y0, int x1, int y1, Fn fn) {
+    const int leftEnd = std::min(x1, sim.spongeWidth + 1);
+    const int rightStart = std::max(x0, sim.width - 1 - sim.spongeWidth);
+    for (int y = y0; y < y1; ++y) {
+        float rowScale = sim.spongeRow[y];
+        if (rowScale < 1.0f || leftEnd >= rightStart) {
+            fn(y, rowScale, x0, x1);
+        } else {
+            if (x0 < leftEnd)
+                fn(y, 1.0f, x0, leftEnd);
+            if (rightStart < x1)
+                fn(y, 1.0f, rightStart, x1);
+        }
+    }
+}
+
+// Default flat cubemap face colours: +X, -X, +Y, -Y, +Z, -Z.
+const Rgba8 kEnvFaces[6] = {
+    { 200, 180, 160, 255 },
+    { 160, 180, 200, 255 },
+    { 180, 200, 255, 255 },
+    { 40, 40, 50, 255 },
+    { 120, 130, 150, 255 },
+    { 80, 70, 60, 255 },
+};
+
+// The chrome brightness curve (unsigned char)(powf(i, 0.6) * 255) sampled
+// at kChromeSteps + 1 points over [0, 1].
+constexpr int kChromeSteps = 4096;
+
+const float *ChromeCurveTable() {
+    static const std::vector<float> table = [] {
+        std::vector<float> t(kChromeSteps + 1);
+        for (int i = 0; i <= kChromeSteps; ++i)
+            t[i] = (float)(unsigned char)(powf((float)i / kChromeSteps, 0.6f) * 255.0f);
+        return t;
+    }();
+    return table.data();
+}
+
+ShadeParams MakeShadeParams(const LiquidSim &sim, float lightX, float lightY) {
+    ShadeParams p;
+    p.lightX = lightX;
+    p.lightY = lightY;
+    p.chromeTable = ChromeCurveTable();
+    p.chromeSteps = kChromeSteps;
+    p.faces = sim.environment.texels.data();
+    p.lut = sim.UsesShadeLut() ? sim.shadeLut.data() : nullptr;
+    p.lutSize = LiquidSim::shadeLutSize;
+    p.lutRange = sim.shadeLutRange;
+    return p;
+}
+
+} // namespace
+
+LiquidSim::LiquidSim(int w, int h, int threads)
+    : width(w), height(h), pitch(PitchFor(w)),
+      stiffness(0.2f), damping(0.985f),
+      heightField((size_t)pitch * h, 0.0f),
+      velocityField((size_t)pitch * h, 0.0f),
+      heightBack((size_t)pitch * h, 0.0f),
+      fusedRows(FusedRowsFor(w)),
+      pool(new ThreadPool(threads)),
+      environment(Environment::FromFaceColors(kEnvFaces)) {
+    tilesX = (w + activeTileSize - 1) / activeTileSize;
+    tilesY = (h + activeTileSize - 1) / activeTileSize;
+    tileAwake.assign(tilesX * tilesY, 0);
+    tileDirty.assign(tilesX * tilesY, 1);
+    tileMaxHeight.assign(tilesX * tilesY, 0.0f);
+    tileMaxVelocity.assign(tilesX * tilesY, 0.0f);
+    tileStepped.assign(tilesX * tilesY, 0);
+}
+
+LiquidSim::~LiquidSim() = default;
+
+void LiquidSim::SetThreadCount(int threads) {
+    pool.reset(new ThreadPool(threads));
+}
+
+int LiquidSim::ThreadCount() const {
+    return pool->Size();
+}
+
+LiquidSim::FusedRowsFn LiquidSim::FusedRowsFor(int width) {
+    for (int i = 0; i < 4; ++i) {
+        if (width == fixedKernelWidths[i])
+            return ActiveKernels().fusedRowsFixed[i];
+    }
+    return FusedRowsGeneric;
+}
+
+void LiquidSim::FusedRowsGeneric(const float *h, float *v, float *out, int pitch,
+                                 int y0, int y1, float k) {
+    ActiveKernels().fusedRows(h, v, out, pitch, y0, y1, k);
+}
+
+// --- Boundary ---
+void LiquidSim::PrepareBoundary() {
+    if (boundary != Boundary::Absorbing)
+        return;
+    if (spongeBuiltWidth == spongeWidth && spongeBuiltStrength == spongeStrength &&
+        spongeRow.size() == (size_t)height)
+        return;
+
+    // Multiplier for the cell d cells in from the wall (d = 1 is the first
+    // interior cell); 1 outside the band.
+    auto profile = [this](int d) {
+        if (d > spongeWidth)
+            return 1.0f;
+        float r = (float)(spongeWidth + 1 - d) / spongeWidth;
+        return 1.0f - spongeStrength * r * r;
+    };
+    spongeColumn.assign(pitch, 1.0f);
+    for (int x = 0; x < width; ++x)
+        spongeColumn[x] = profile(std::min(x, width - 1 - x));
+    spongeRow.resize(height);
+    for (int y = 0; y < height; ++y)
+        spongeRow[y] = profile(std::min(y, height - 1 - y));
+    spongeBuiltWidth = spongeWidth;
+    spongeBuiltStrength = spongeStrength;
+}
+
+void LiquidSim::ApplyBoundaryRows(float *h, float *v, int firstRow, int y0, int y1) const {
+    if (boundary == Boundary::Absorbing)
+        ApplySponge(h, v, firstRow, 0, y0, pitch, y1);
+    ApplyGhostColumns(h, v, firstRow, y0, y1);
+}
+
+// Full-row kernels only read neighbours that are ghosts or interior
+// cells, so the ghost columns are all the boundary needs.
+void LiquidSim::ApplyGhostColumns(float *h, float *v, int firstRow, int y0, int y1) const {
+    GhostColumns(*this, h, v, firstRow, y0, y1);
+}
+
+// Scales h and v in [x0, x1) x [y0, y1) by the sponge profile,
+// min(column, row) multiplier per cell. Rows outside the top and bottom
+// bands only touch the left and right bands.
+void LiquidSim::ApplySponge(float *h, float *v, int firstRow, int x0, int y0, int x1, int y1) const {
+    const SimKernels &kernels = ActiveKernels();
+    const float *column = spongeColumn.data();
+    ForSpongeSegments(*this, x0, y0, x1, y1, [&](int y, float rowScale, int a, int b) {
+        kernels.sponge(h + (size_t)(y - firstRow) * pitch, v + (size_t)(y - firstRow) * pitch,
+                       column, rowScale, a, b);
+    });
+}
+
+void LiquidSim::ApplyGhostRows(float *h, int firstRow, int lastRow) const {
+    GhostRows(*this, h, firstRow, lastRow);
+}
+
+// --- Reduced-precision storage ---
+void LiquidSim::SetStorage(Storage s) {
+    // FusedRowsFixed16 clamps the Q14 stiffness to 0.5.
+    assert(s != Storage::Fixed16 || stiffness <= 0.5f);
+    if (s == storage)
+        return;
+    const size_t cells = (size_t)pitch * height;
+    if (storage != Storage::Float32) {
+        // Decode the whole state back into fp32 planes.
+        velocityField.resize(cells);
+        heightBack.resize(cells);
+        pool->ParallelFor(0, height, [&](int y0, int y1) {
+            size_t first = (size_t)y0 * pitch;
+            size_t n = (size_t)(y1 - y0) * pitch;
+            DecodeRow(packedHeight.data() + first, heightField.data() + first, n, fixedFractionBits);
+            DecodeRow(packedBack.data() + first, heightBack.data() + first, n, fixedFractionBits);
+            DecodeRow(packedVelocity.data() + first, velocityField.data() + first, n,
+                      VelocityFractionBits());
+        }, minRowsPerBand);
+        PackedField().swap(packedHeight);
+        PackedField().swap(packedBack);
+        PackedField().swap(packedVelocity);
+        storage = Storage::Float32;
+    }
+    if (s != Storage::Float32) {
+        storage = s;
+        packedHeight.resize(cells);
+        packedBack.resize(cells);
+        packedVelocity.resize(cells);
+        pool->ParallelFor(0, height, [&](int y0, int y1) {
+            size_t first = (size_t)y0 * pitch;
+            size_t n = (size_t)(y1 - y0) * pitch;
+            EncodeRow(heightField.data() + first, packedHeight.data() + first, n, fixedFractionBits);
+            EncodeRow(heightBack.data() + first, packedBack.data() + first, n, fixedFractionBits);
+            EncodeRow(velocityField.data() + first, packedVelocity.data() + first, n,
+                      VelocityFractionBits());
+        }, minRowsPerBand);
+        Field().swap(velocityField);
+        Field().swap(velocityBack);
+        if (!keepPreviousHeights)
+            Field().swap(heightBack);
+        packedDirty = true; // show the rounded heights
+    }
+    WakeAllTiles();
+}
+
+void LiquidSim::SyncHeights() {
+    if (storage == Storage::Float32 || !packedDirty)
+        return;
+    const bool back = keepPreviousHeights;
+    if (back && heightBack.size() != packedBack.size())
+        heightBack.assign(packedBack.size(), 0.0f);
+    pool->ParallelFor(0, height, [&](int y0, int y1) {
+        size_t first = (size_t)y0 * pitch;
+        size_t n = (size_t)(y1 - y0) * pitch;
+        DecodeRow(packedHeight.data() + first, heightField.data() + first, n, fixedFractionBits);
+        if (back)
+            DecodeRow(packedBack.data() + first, heightBack.data() + first, n, fixedFractionBits);
+    }, minRowsPerBand);
+    packedDirty = false;
+}
+
+void LiquidSim::DecodeRow(const uint16_t *in, float *out, size_t n, int fractionBits) const {
+    if (storage == Storage::Half)
+        ActiveKernels().decodeHalf(in, out, n);
+    else
+        ActiveKernels().decodeFixed16((const int16_t *)in, out, n, std::ldexp(1.0f, -fractionBits));
+}
+
+// Fixed16 rounds to nearest and saturates to the int16 range.
+void LiquidSim::EncodeRow(const float *in, uint16_t *out, size_t n, int fractionBits) const {
+    if (storage == Storage::Half)
+        ActiveKernels().encodeHalf(in, out, n);
+    else
+        ActiveKernels().encodeFixed16(in, (int16_t *)out, n, std::ldexp(1.0f, fractionBits));
+}
+
+// Dense fused step on the packed planes, in the same bands as StepFused().
+void LiquidSim::StepPacked() {
+    const SimKernels &kernels = ActiveKernels();
+    SimKernels::PackedRowsFn rows =
+        storage == Storage::Half ? kernels.fusedRowsHalf : kernels.fusedRowsFixed16;
+    pool->ParallelFor(1, height - 1, [this, rows](int y0, int y1) {
+        rows(packedHeight.data(), packedVelocity.data(), packedBack.data(), pitch, y0, y1, stiffness);
+        ApplyBoundaryRows(packedBack.data(), packedVelocity.data(), y0, y1);
+    }, minRowsPerBand);
+    packedHeight.swap(packedBack);
+    ApplyGhostRows(packedHeight.data());
+    packedDirty = true;
+}
+
+// The sponge runs through fp32 in short chunks.
+void LiquidSim::ApplyBoundaryRows(uint16_t *h, uint16_t *v, int y0, int y1) const {
+    if (boundary == Boundary::Absorbing) {
+        ForSpongeSegments(*this, 0, y0, pitch, y1, [&](int y, float rowScale, int a, int b) {
+            constexpr int chunk = 64;
+            float hs[chunk];
+            float vs[chunk];
+            for (int c = a; c < b; c += chunk) {
+                int n = std::min(b - c, chunk);
+                uint16_t *hr = h + (size_t)y * pitch + c;
+                uint16_t *vr = v + (size_t)y * pitch + c;
+                DecodeRow(hr, hs, n, fixedFractionBits);
+                DecodeRow(vr, vs, n, VelocityFractionBits());
+                for (int i = 0; i < n; ++i) {
+                    float m = std::min(spongeColumn[c + i], rowScale);
+                    hs[i] *= m;
+                    vs[i] *= m;
+                }
+                EncodeRow(hs, hr, n, fixedFractionBits);
+                EncodeRow(vs, vr, n, VelocityFractionBits());
+            }
+        });
+    }
+    GhostColumns(*this, h, v, 0, y0, y1);
+}
+
+void LiquidSim::ApplyGhostRows(uint16_t *h) const {
+    GhostRows(*this, h, 0, height);
+}
+
+void LiquidSim::AddToHeights(int x0, int y, int n, float a, const float *w) {
+    if (storage == Storage::Float32) {
+        float *row = heightField.data() + idx(x0, y);
+        if (simdStep) {
+            ActiveKernels().addScaledRow(row, w, a, n);
+            return;
+        }
+        for (int i = 0; i < n; ++i)
+            row[i] += a * w[i];
+        return;
+    }
+
+    constexpr int chunk = 64;
+    float cells[chunk];
+    uint16_t *row = packedHeight.data() + idx(x0, y);
+    for (int c = 0; c < n; c += chunk) {
+        int m = std::min(n - c, chunk);
+        DecodeRow(row + c, cells, m, fixedFractionBits);
+        for (int i = 0; i < m; ++i)
+            cells[i] += a * w[c + i];
+        EncodeRow(cells, row + c, m, fixedFractionBits);
+    }
+}
+
+const char *LiquidSim::SimdName() {
+    return ActiveKernels().name;
+}
+
+void LiquidSim::AddImpulse(int x, int y, float amount, int radius) {
+    radius = std::min(radius, (int)impulseSupport);
+    if (radius < 0)
+        return;
+    int y0 = std::max(y - radius, 1);
+    int y1 = std::min(y + radius + 1, height - 1);
+    if (x + radius < 1 || x - radius >= width - 1 || y0 >= y1)
+        return;
+
+    const ImpulseKernel &kernel = GetImpulseKernel(radius);
+    const int size = 2 * radius + 1;
+    for (int cy = y0; cy < y1; ++cy) {
+        int r = cy - y + radius;
+        int hw = kernel.halfWidth[r];
+        int x0 = std::max(x - hw, 1);
+        int x1 = std::min(x + hw + 1, width - 1);
+        int n = x1 - x0;
+        if (n <= 0)
+            continue;
+
+        const float *w;
+        float a;
+        if (separableImpulse) {
+            w = kernel.weights.data() + (x0 - x + radius);
+            a = amount * kernel.weights[r];
+        } else {
+            w = kernel.stamp.data() + (size_t)r * size + (x0 - x + radius);
+            a = amount;
+        }
+
+        AddToHeights(x0, cy, n, a, w);
+    }
+    WakeTiles(x - radius, y0, x + radius + 1, y1);
+    RefreshInputGhosts(std::max(x - radius, 1), y0, std::min(x + radius + 1, width - 1), y1);
+    packedDirty = true;
+}
+
+// Input wrote interior cells [x0, x1) x [y0, y1). Ghosts copied from
+// those cells (all but Fixed walls) would otherwise keep their old values
+// until the next step had already read them.
+void LiquidSim::RefreshInputGhosts(int x0, int y0, int x1, int y1) {
+    if (boundary == Boundary::Fixed || x0 >= x1 || y0 >= y1)
+        return;
+    const bool columns = x0 <= 1 || x1 >= width - 1;
+    const bool rows = y0 <= 1 || y1 >= height - 1;
+    if (storage == Storage::Float32) {
+        if (columns)
+            ApplyGhostColumns(heightField.data(), velocityField.data(), 0, y0, y1);
+        if (rows)
+            ApplyGhostRows(heightField.data(), 0, height);
+    } else {
+        if (columns)
+            GhostColumns(*this, packedHeight.data(), packedVelocity.data(), 0, y0, y1);
+        if (rows)
+            ApplyGhostRows(packedHeight.data());
+    }
+}
+
+const LiquidSim::ImpulseKernel &LiquidSim::GetImpulseKernel(int radius) {
+    if ((int)impulseKernels.size() <= radius)
+        impulseKernels.resize(radius + 1);
+    ImpulseKernel &k = impulseKernels[radius];
+    if (!k.stamp.empty())
+        return k;
+
+    int size = 2 * radius + 1;
+    k.stamp.assign((size_t)size * size, 0.0f);
+    k.weights.resize(size);
+    k.halfWidth.assign(size, -1);
+    for (int i = -radius; i <= radius; ++i)
+        k.weights[i + radius] = std::exp(-float(i * i) * 0.5f);
+    for (int j = -radius; j <= radius; ++j) {
+        for (int i = -radius; i <= radius; ++i) {
+            float dist2 = float(i * i + j * j);
+            float falloff = std::exp(-dist2 * 0.5f);
+            if (falloff < FLT_MIN)
+                continue;
+            k.stamp[(size_t)(j + radius) * size + (i + radius)] = falloff;
+            k.halfWidth[j + radius] = std::max(k.halfWidth[j + radius], std::abs(i));
+        }
+    }
+    return k;
+}
+
+// --- Strokes ---
+void LiquidSim::QueueStroke(float x0, float y0, float x1, float y1, float amount, int radius) {
+    float len = std::sqrt((x1 - x0) * (x1 - x0) + (y1 - y0) * (y1 - y0));
+    int n = std::max(1, (int)std::ceil(len / strokeSpacing));
+    float perStamp = amount * std::max(len, 1.0f) / n;
+    for (int k = 1; k <= n; ++k) {
+        float t = (float)k / n;
+        QueueStamp(x0 + (x1 - x0) * t, y0 + (y1 - y0) * t, perStamp, radius);
+    }
+}
+
+float LiquidSim::StrokeFalloff(float t) const {
+    float f = std::fabs(t) * strokeKernelSteps;
+    int i = (int)f;
+    return strokeKernel[i] + (strokeKernel[i + 1] - strokeKernel[i]) * (f - i);
+}
+
+void LiquidSim::QueueStamp(float x, float y, float amount, int radius) {
+    // Cells within radius of the centre on each axis, as in AddImpulse(),
+    // clipped to the interior and to the falloff's support.
+    radius = std::min(radius, (int)impulseSupport + 1);
+    int x0 = std::max((int)std::ceil(x - radius), 1);
+    int x1 = std::min((int)std::floor(x + radius) + 1, width - 1);
+    int y0 = std::max((int)std::ceil(y - radius), 1);
+    int y1 = std::min((int)std::floor(y + radius) + 1, height - 1);
+    if (x0 >= x1 || y0 >= y1)
+        return;
+
+    size_t needed = (size_t)(radius + 2) * strokeKernelSteps;
+    if (strokeKernel.size() < needed) {
+        strokeKernel.resize(needed);
+        for (size_t i = 0; i < needed; ++i) {
+            float t = (float)i / strokeKernelSteps;
+            strokeKernel[i] = std::exp(-t * t * 0.5f);
+        }
+    }
+
+    Stamp stamp = { amount, x0, y0, x1, y1, stampWeights.size() };
+    for (int i = x0; i < x1; ++i)
+        stampWeights.push_back(StrokeFalloff(i - x));
+    for (int j = y0; j < y1; ++j)
+        stampWeights.push_back(StrokeFalloff(j - y));
+    stamps.push_back(stamp);
+    WakeTiles(x0, y0, x1, y1);
+}
+
+void LiquidSim::FlushStrokes() {
+    if (stamps.empty())
+        return;
+    int x0 = width;
+    int y0 = height;
+    int x1 = 0;
+    int y1 = 0;
+    for (const Stamp &s : stamps) {
+        x0 = std::min(x0, s.x0);
+        y0 = std::min(y0, s.y0);
+        x1 = std::max(x1, s.x1);
+        y1 = std::max(y1, s.y1);
+    }
+
+    pool->ParallelFor(y0, y1, [this](int b, int e) {
+        for (const Stamp &s : stamps) {
+            const float *wx = stampWeights.data() + s.weights;
+            const float *wy = wx + (s.x1 - s.x0);
+            int rowEnd = std::min(e, s.y1);
+            for (int y = std::max(b, s.y0); y < rowEnd; ++y)
+                AddToHeights(s.x0, y, s.x1 - s.x0, s.amount * wy[y - s.y0], wx);
+        }
+    }, minRowsPerBand);
+    RefreshInputGhosts(x0, y0, x1, y1);
+    packedDirty = true;
+
+    stamps.clear();
+    stampWeights.clear();
+}
+
+bool LiquidSim::PostStroke(float x0, float y0, float x1, float y1, float amount, int radius) {
+    return posted.TryPush({ x0, y0, x1, y1, amount, radius });
+}
+
+void LiquidSim::ApplyPendingInput() {
+    // At most one queue's worth, so busy producers cannot stall the step.
+    PostedStroke p;
+    for (size_t n = posted.Capacity(); n > 0 && posted.TryPop(p); --n)
+        QueueStroke(p.x0, p.y0, p.x1, p.y1, p.amount, p.radius);
+    FlushStrokes();
+}
+
+void LiquidSim::AddStroke(float x0, float y0, float x1, float y1, float amount, int radius) {
+    QueueStroke(x0, y0, x1, y1, amount, radius);
+    FlushStrokes();
+}
+
+void LiquidSim::WakeTiles(int x0, int y0, int x1, int y1) {
+    int tx0 = std::max(0, x0) / activeTileSize;
+    int ty0 = std::max(0, y0) / activeTileSize;
+    int tx1 = std::min(width - 1, x1 - 1) / activeTileSize;
+    int ty1 = std::min(height - 1, y1 - 1) / activeTileSize;
+    for (int ty = ty0; ty <= ty1; ++ty) {
+        for (int tx = tx0; tx <= tx1; ++tx) {
+            tileAwake[ty * tilesX + tx] = 1;
+            tileDirty[ty * tilesX + tx] = 1;
+        }
+    }
+}
+
+void LiquidSim::WakeAllTiles() {
+    std::fill(tileAwake.begin(), tileAwake.end(), 1);
+    std::fill(tileDirty.begin(), tileDirty.end(), 1);
+}
+
+int LiquidSim::AwakeTileCount() const {
+    return (int)std::count(tileAwake.begin(), tileAwake.end(), 1);
+}
+
+void LiquidSim::Step() {
+    ApplyPendingInput();
+    PrepareBoundary();
+    if (storage != Storage::Float32) {
+        StepPacked();
+        WakeAllTiles();
+        std::fill(tileStepped.begin(), tileStepped.end(), 1);
+        return;
+    }
+    if (stepMode == StepMode::Fused && sparseTiles) {
+        StepFusedSparse();
+        return;
+    }
+
+    if (stepMode == StepMode::TwoPass && keepPreviousHeights)
+        heightBack = heightField;
+
+    if (stepMode == StepMode::Fused)
+        StepFused();
+    else if (simdStep)
+        StepSimd();
+    else
+        StepScalar();
+    WakeAllTiles();
+    std::fill(tileStepped.begin(), tileStepped.end(), 1);
+}
+
+bool LiquidSim::UsesSparseTiles() const {
+    return sparseTiles && stepMode == StepMode::Fused && storage == Storage::Float32;
+}
+
+bool LiquidSim::UsesTemporalBlocking() const {
+    if (!temporalBlocking || temporalDepth < 2)
+        return false;
+    if (boundary == Boundary::Periodic)
+        return false; // the wrap couples the first and last row tiles
+    if (storage != Storage::Float32)
+        return false;
+    return 2 * (size_t)pitch * height * sizeof(float) >= temporalMinBytes;
+}
+
+void LiquidSim::Advance(int steps) {
+    ApplyPendingInput();
+    PrepareBoundary();
+    const bool blocked = UsesTemporalBlocking();
+    while (steps > 0) {
+        int k = blocked ? std::min(steps, temporalDepth) : 1;
+        if (sparseTiles && AwakeTileCount() * 2 < tilesX * tilesY)
+            k = 1;
+        if (keepPreviousHeights && k == steps)
+            k = std::max(1, k - 1); // finish on a single step
+        if (k > 1) {
+            StepTemporal(k);
+            std::fill(tileStepped.begin(), tileStepped.end(), 1);
+        } else {
+            Step();
+        }
+        steps -= k;
+    }
+}
+
+void LiquidSim::StepScalar() {
+    for (int y = 1; y < height - 1; ++y) {
+        for (int x = 1; x < width - 1; ++x) {
+            float center = heightField[idx(x, y)];
+            float sumNeighbors =
+                heightField[idx(x - 1, y)] +
+                heightField[idx(x + 1, y)] +
+                heightField[idx(x, y - 1)] +
+                heightField[idx(x, y + 1)];
+
+            float force = (sumNeighbors - 4.0f * center) * stiffness;
+            velocityField[idx(x, y)] += force;
+        }
+    }
+
+    for (int y = 1; y < height - 1; ++y) {
+        for (int x = 1; x < width - 1; ++x) {
+            //THIS IS WHERE DAMPING LIVES
+            
+            //Originally:
+            //velocityField[idx(x, y)] *= damping;
+            velocityField[idx(x, y)] *= 0.94f;
+            heightField[idx(x, y)] += velocityField[idx(x, y)];
+        }
+    }
+    ApplyBoundaryRows(heightField.data(), velocityField.data(), 0, 1, height - 1);
+    ApplyGhostRows(heightField.data(), 0, height);
+}
+
+// Vectorized Step(): same two passes as StepScalar(), one vector of cells
+// per iteration along x over full rows.
+//
+// Every lane evaluates the scalar expressions in the same order
+// ((hL + hR) + hU) + hD, (sum - 4c) * k, (v * 0.94) + h, so the result is
+// bit-identical to StepScalar() as long as the compiler does not contract
+// the scalar path into FMAs. With contraction enabled (-mfma together with
+// -ffp-contract=fast) each cell differs by at most 1 ulp per step, which
+// keeps both fields within 1e-5 absolute of each other for the impulse
+// magnitudes used here.
+//
+// Each pass runs as row bands on the pool, one barrier per pass.
+void LiquidSim::StepSimd() {
+    pool->ParallelFor(1, height - 1, [this](int y0, int y1) { StepForceRows(y0, y1); },
+                      minRowsPerBand);
+    pool->ParallelFor(1, height - 1, [this](int y0, int y1) { StepIntegrateRows(y0, y1); },
+                      minRowsPerBand);
+    ApplyGhostRows(heightField.data(), 0, height);
+}
+
+void LiquidSim::StepForceRows(int y0, int y1) {
+    ActiveKernels().forceRows(heightField.data(), velocityField.data(), pitch, y0, y1, stiffness);
+}
+
+void LiquidSim::StepIntegrateRows(int y0, int y1) {
+    ActiveKernels().integrateRows(heightField.data(), velocityField.data(), pitch, y0, y1);
+    ApplyBoundaryRows(heightField.data(), velocityField.data(), 0, y0, y1);
+}
+
+// Single sweep over the grid: heightField is only read, heightBack only
+// written, then the two are swapped (pointer swap, no copy). Bands never
+// write anything another band reads, so the only sync is the barrier at
+// the end of ParallelFor().
+void LiquidSim::StepFused() {
+    FusedRowsFn rows = simdStep ? fusedRows : FusedRowsScalar;
+    pool->ParallelFor(1, height - 1, [this, rows](int y0, int y1) {
+        rows(heightField.data(), velocityField.data(), heightBack.data(), pitch, y0, y1, stiffness);
+        ApplyBoundaryRows(heightBack.data(), velocityField.data(), 0, y0, y1);
+    }, minRowsPerBand);
+    heightField.swap(heightBack);
+    ApplyGhostRows(heightField.data(), 0, height);
+}
+
+// Fused step restricted to awake tiles and their neighbours.
+void LiquidSim::StepFusedSparse() {
+    std::fill(tileStepped.begin(), tileStepped.end(), 0);
+    activeTiles.clear();
+
+    // Tile neighbours along one axis. With periodic walls the first tile
+    // and the last one holding interior cells are neighbours too.
+    const bool wrap = boundary == Boundary::Periodic;
+    auto neighbours = [wrap](int t, int count, int last, int *out) {
+        int n = 0;
+        for (int i = std::max(0, t - 1); i <= std::min(count - 1, t + 1); ++i)
+            out[n++] = i;
+        if (wrap && t == 0)
+            out[n++] = last;
+        if (wrap && t == last)
+            out[n++] = 0;
+        return n;
+    };
+    const int lastX = (width - 2) / activeTileSize;
+    const int lastY = (height - 2) / activeTileSize;
+    for (int ty = 0; ty < tilesY; ++ty) {
+        int ny[5];
+        int nyCount = neighbours(ty, tilesY, lastY, ny);
+        for (int tx = 0; tx < tilesX; ++tx) {
+            int nx[5];
+            int nxCount = neighbours(tx, tilesX, lastX, nx);
+            bool active = false;
+            for (int j = 0; j < nyCount && !active; ++j)
+                for (int i = 0; i < nxCount && !active; ++i)
+                    active = tileAwake[ny[j] * tilesX + nx[i]] != 0;
+            if (active)
+                activeTiles.push_back(ty * tilesX + tx);
+        }
+    }
+    if (activeTiles.empty())
+        return;
+
+    pool->ParallelFor(0, (int)activeTiles.size(), [this](int i0, int i1) {
+        for (int i = i0; i < i1; ++i)
+            StepTile(activeTiles[i]);
+    }, 4);
+
+    heightField.swap(heightBack);
+
+    // Tiles never write ghosts, which are zero for fixed walls; the others
+    // copy interior cells, refreshed here for the whole perimeter.
+    if (boundary != Boundary::Fixed) {
+        ApplyGhostColumns(heightField.data(), velocityField.data(), 0, 1, height - 1);
+        ApplyGhostRows(heightField.data(), 0, height);
+    }
+
+    // The old front buffer still holds pre-step values for tiles that
+    // just went to sleep; clear them so the invariant holds for both.
+    for (int t : activeTiles) {
+        if (!tileAwake[t])
+            ClearTile(heightBack, t);
+    }
+}
+
+void LiquidSim::TileBounds(int t, int &x0, int &y0, int &x1, int &y1) const {
+    int tx = t % tilesX;
+    int ty = t / tilesX;
+    x0 = std::max(1, tx * activeTileSize);
+    y0 = std::max(1, ty * activeTileSize);
+    x1 = std::min(width - 1, (tx + 1) * activeTileSize);
+    y1 = std::min(height - 1, (ty + 1) * activeTileSize);
+}
+
+void LiquidSim::ClearTile(Field &field, int t) {
+    int x0, y0, x1, y1;
+    TileBounds(t, x0, y0, x1, y1);
+    for (int y = y0; y < y1; ++y)
+        std::fill(&field[idx(x0, y)], &field[idx(x1, y)], 0.0f);
+}
+
+void LiquidSim::StepTile(int t) {
+    int x0, y0, x1, y1;
+    TileBounds(t, x0, y0, x1, y1);
+
+    auto row = simdStep ? ActiveKernels().fusedRow : StepFusedRow;
+    float maxH = 0.0f;
+    float maxV = 0.0f;
+    for (int y = y0; y < y1; ++y) {
+        float *v = &velocityField[idx(0, y)];
+        float *out = &heightBack[idx(0, y)];
+        row(&heightField[idx(0, y - 1)], &heightField[idx(0, y)],
+            &heightField[idx(0, y + 1)], v, out, x0, x1, stiffness);
+        if (boundary == Boundary::Absorbing)
+            ApplySponge(heightBack.data(), velocityField.data(), 0, x0, y, x1, y + 1);
+        for (int x = x0; x < x1; ++x) {
+            maxH = std::max(maxH, std::fabs(out[x]));
+            maxV = std::max(maxV, std::fabs(v[x]));
+        }
+    }
+
+    tileMaxHeight[t] = maxH;
+    tileMaxVelocity[t] = maxV;
+    tileDirty[t] = 1;
+    tileStepped[t] = 1;
+    tileAwake[t] = (maxH > sleepEpsilon || maxV > sleepEpsilon) ? 1 : 0;
+    if (!tileAwake[t]) {
+        ClearTile(heightBack, t);
+        ClearTile(velocityField, t);
+    }
+}
+
+int LiquidSim::TemporalTileRows(int k) const {
+    // Three scratch planes (two heights, one velocity) of tile + halo rows.
+    int rows = (int)(tileCacheBytes / (3 * (size_t)pitch * sizeof(float))) - 2 * k;
+    return std::max(rows, 2 * k);
+}
+
+void LiquidSim::StepTemporal(int k) {
+    if (velocityBack.size() != velocityField.size())
+        velocityBack.assign(velocityField.size(), 0.0f);
+    if (sparseTiles && rowTileMaxHeight.size() != (size_t)height * tilesX) {
+        rowTileMaxHeight.assign((size_t)height * tilesX, 0.0f);
+        rowTileMaxVelocity.assign((size_t)height * tilesX, 0.0f);
+    }
+
+    const int tileRows = TemporalTileRows(k);
+    const int interior = height - 2;
+    const int tiles = (interior + tileRows - 1) / tileRows;
+
+    pool->ParallelFor(0, tiles, [&](int t0, int t1) {
+        for (int t = t0; t < t1; ++t) {
+            int y0 = 1 + t * tileRows;
+            int y1 = std::min(y0 + tileRows, height - 1);
+            StepTemporalTile(y0, y1, k);
+        }
+    });
+
+    heightField.swap(heightBack);
+    velocityField.swap(velocityBack);
+    ApplyGhostRows(heightField.data(), 0, height);
+    if (sparseTiles)
+        SettleTemporalTiles();
+    else
+        WakeAllTiles();
+}
+
+// Applies StepTile()'s sleep rule to every tile after a temporal chunk,
+// from the per-row maxima StepTemporalTile() left behind, so a settled
+// surface returns to sparse stepping.
+void LiquidSim::SettleTemporalTiles() {
+    bool slept = false;
+    for (int t = 0; t < tilesX * tilesY; ++t) {
+        int x0, y0, x1, y1;
+        TileBounds(t, x0, y0, x1, y1);
+        const int tx = t % tilesX;
+        float maxH = 0.0f;
+        float maxV = 0.0f;
+        for (int y = y0; y < y1; ++y) {
+            maxH = std::max(maxH, rowTileMaxHeight[(size_t)y * tilesX + tx]);
+            maxV = std::max(maxV, rowTileMaxVelocity[(size_t)y * tilesX + tx]);
+        }
+
+        tileMaxHeight[t] = maxH;
+        tileMaxVelocity[t] = maxV;
+        tileDirty[t] = 1;
+        tileAwake[t] = (maxH > sleepEpsilon || maxV > sleepEpsilon) ? 1 : 0;
+        if (!tileAwake[t]) {
+            ClearTile(heightField, t);
+            ClearTile(heightBack, t);
+            ClearTile(velocityField, t);
+            slept = true;
+        }
+    }
+
+    if (slept && boundary != Boundary::Fixed) {
+        ApplyGhostColumns(heightField.data(), velocityField.data(), 0, 1, height - 1);
+        ApplyGhostRows(heightField.data(), 0, height);
+    }
+}
+
+// Advances rows [y0, y1) by k steps using only scratch memory, reading
+// heightField/velocityField and writing heightBack/velocityBack. With
+// sparse tiles the write-back also records each row's max |h| and |v| per
+// activity tile for SettleTemporalTiles(); every row belongs to exactly
+// one band, so bands never write the same entry.
+void LiquidSim::StepTemporalTile(int y0, int y1, int k) {
+    thread_local Field scratch;
+
+    const int r0 = std::max(0, y0 - k);
+    const int r1 = std::min(height, y1 + k);
+    const size_t plane = (size_t)(r1 - r0) * pitch;
+    if (scratch.size() < 3 * plane)
+        scratch.resize(3 * plane);
+
+    float *hA = scratch.data();
+    float *hB = hA + plane;
+    float *v = hB + plane;
+    std::memcpy(hA, &heightField[idx(0, r0)], plane * sizeof(float));
+    std::memcpy(hB, hA, plane * sizeof(float));
+    std::memcpy(v, &velocityField[idx(0, r0)], plane * sizeof(float));
+
+    FusedRowsFn rows = simdStep ? fusedRows : FusedRowsScalar;
+    for (int s = 1; s <= k; ++s) {
+        int u0 = std::max(1, y0 - k + s);
+        int u1 = std::min(height - 1, y1 + k - s);
+        rows(hA, v, hB, pitch, u0 - r0, u1 - r0, stiffness);
+        ApplyBoundaryRows(hB, v, r0, u0, u1);
+        ApplyGhostRows(hB, r0, r1);
+        std::swap(hA, hB);
+    }
+
+    size_t tile = (size_t)(y0 - r0) * pitch;
+    size_t count = (size_t)(y1 - y0) * pitch;
+    std::memcpy(&heightBack[idx(0, y0)], hA + tile, count * sizeof(float));
+    std::memcpy(&velocityBack[idx(0, y0)], v + tile, count * sizeof(float));
+
+    if (!sparseTiles)
+        return;
+    for (int y = y0; y < y1; ++y) {
+        const float *hRow = hA + (size_t)(y - r0) * pitch;
+        const float *vRow = v + (size_t)(y - r0) * pitch;
+        for (int tx = 0; tx < tilesX; ++tx) {
+            int x0 = std::max(1, tx * activeTileSize);
+            int x1 = std::min(width - 1, (tx + 1) * activeTileSize);
+            float maxH = 0.0f;
+            float maxV = 0.0f;
+            for (int x = x0; x < x1; ++x) {
+                maxH = std::max(maxH, std::fabs(hRow[x]));
+                maxV = std::max(maxV, std::fabs(vRow[x]));
+            }
+            rowTileMaxHeight[(size_t)y * tilesX + tx] = maxH;
+            rowTileMaxVelocity[(size_t)y * tilesX + tx] = maxV;
+        }
+    }
+}
+
+// --- Cubemap reflection ---
+void LiquidSim::SetEnvironment(Environment env) {
+    environment = std::move(env);
+    InvalidateShading();
+}
+
+Rgba8 LiquidSim::SampleCubemap(float nx, float ny, float nz) const {
+    return environment.Sample(nx, ny, nz, environmentLod);
+}
+
+Rgba8 LiquidSim::ShadeGradient(float dx, float dy, float lightX, float lightY) const {
+    float nx = -dx;
+    float ny = -dy;
+    float nz = 1.0f;
+    float len = std::sqrt(nx*nx + ny*ny + nz*nz);
+    if (len > 0.0f) {
+        nx /= len;
+        ny /= len;
+        nz /= len;
+    }
+
+    float ndotl = nx * lightX + ny * lightY + nz * 1.0f;
+    float base = 0.4f;
+    float intensity = base + ndotl * 0.6f;
+    intensity = std::min(std::max(intensity, 0.0f), 1.0f);
+
+    // Chrome brightness curve
+    float boosted = powf(intensity, 0.6f);
+    unsigned char chrome = (unsigned char)(boosted * 255.0f);
+
+    // Sample cubemap
+    Rgba8 env = SampleCubemap(nx, ny, nz);
+
+    // Blend chrome with cubemap
+    unsigned char finalR = (unsigned char)(chrome * 0.4f + env.r * 0.6f);
+    unsigned char finalG = (unsigned char)(chrome * 0.4f + env.g * 0.6f);
+    unsigned char finalB = (unsigned char)(chrome * 0.4f + env.b * 0.6f);
+
+    // Semi-transparent chrome
+    return { finalR, finalG, finalB, 180 };
+}
+
+Rgba8 LiquidSim::ShadeLut(float dx, float dy) const {
+    const int n = shadeLutSize;
+    const float scale = n / (2.0f * shadeLutRange);
+    float fx = (dx + shadeLutRange) * scale;
+    float fy = (dy + shadeLutRange) * scale;
+    int ix = (int)std::min(std::max(fx, 0.0f), (float)(n - 1));
+    int iy = (int)std::min(std::max(fy, 0.0f), (float)(n - 1));
+    return shadeLut[(size_t)iy * n + ix];
+}
+
+void LiquidSim::InvalidateShading() {
+    shadeLut.clear();
+    std::fill(tileDirty.begin(), tileDirty.end(), 1);
+}
+
+void LiquidSim::BuildShadeLut(float lightX, float lightY) {
+    const int n = shadeLutSize;
+    const float step = 2.0f * shadeLutRange / n;
+    shadeLut.resize((size_t)n * n);
+    for (int j = 0; j < n; ++j) {
+        float dy = -shadeLutRange + (j + 0.5f) * step;
+        for (int i = 0; i < n; ++i) {
+            float dx = -shadeLutRange + (i + 0.5f) * step;
+            shadeLut[(size_t)j * n + i] = ShadeGradient(dx, dy, lightX, lightY);
+        }
+    }
+    shadeLutLightX = lightX;
+    shadeLutLightY = lightY;
+}
+
+bool LiquidSim::BeginRender(float lightX, float lightY) {
+    SyncHeights();
+    if (lightX != renderedLightX || lightY != renderedLightY) {
+        std::fill(tileDirty.begin(), tileDirty.end(), 1);
+        renderedLightX = lightX;
+        renderedLightY = lightY;
+    }
+    if (UsesShadeLut() && (shadeLut.empty() || shadeLutLightX != lightX || shadeLutLightY != lightY))
+        BuildShadeLut(lightX, lightY);
+
+    bool interpolate = keepPreviousHeights && renderAlpha < 1.0f;
+    if (renderAlpha != renderedAlpha) {
+        for (size_t t = 0; t < tileDirty.size(); ++t)
+            tileDirty[t] |= tileStepped[t];
+        renderedAlpha = renderAlpha;
+    }
+    if (interpolate && heightRender.size() != heightField.size())
+        heightRender.assign(heightField.size(), 0.0f);
+    return interpolate;
+}
+
+void LiquidSim::RenderToImage(RGBA8Span img, float lightX, float lightY) {
+    bool interpolate = BeginRender(lightX, lightY);
+    const float *field = interpolate ? heightRender.data() : heightField.data();
+
+    dirtyRects.clear();
+    for (int ty = 0; ty < tilesY; ++ty) {
+        int spanX0 = width;
+        int spanX1 = 0;
+        int spanY0 = 0;
+        int spanY1 = 0;
+        for (int tx = 0; tx < tilesX; ++tx) {
+            int t = ty * tilesX + tx;
+            if (!tileDirty[t])
+                continue;
+            int x0, y0, x1, y1;
+            TileBounds(t, x0, y0, x1, y1);
+            if (interpolate) {
+                // Blend the tile plus its one-cell stencil halo.
+                for (int y = y0 - 1; y <= y1; ++y) {
+                    for (int x = x0 - 1; x <= x1; ++x) {
+                        size_t i = idx(x, y);
+                        heightRender[i] = heightBack[i] + (heightField[i] - heightBack[i]) * renderAlpha;
+                    }
+                }
+            }
+            RenderRect(img, field, lightX, lightY, x0, y0, x1, y1);
+            tileDirty[t] = 0;
+            spanX0 = std::min(spanX0, x0);
+            spanX1 = std::max(spanX1, x1);
+            spanY0 = y0;
+            spanY1 = y1;
+        }
+        if (spanX0 >= spanX1)
+            continue;
+        // Widen interior-wide spans over the untouched border columns so
+        // the upload can use the image rows in place.
+        if (spanX0 == 1 && spanX1 == width - 1) {
+            spanX0 = 0;
+            spanX1 = width;
+        }
+
+        DirtyRect *last = dirtyRects.empty() ? nullptr : &dirtyRects.back();
+        if (last && last->x == spanX0 && last->w == spanX1 - spanX0 &&
+            last->y + last->h == spanY0)
+            last->h += spanY1 - spanY0;
+        else
+            dirtyRects.push_back({ spanX0, spanY0, spanX1 - spanX0, spanY1 - spanY0 });
+    }
+}
+
+void LiquidSim::RenderRect(RGBA8Span img, const float *field, float lightX, float lightY,
+                           int x0, int y0, int x1, int y1) const {
+    bool lut = UsesShadeLut();
+    int vectorEnd = x0;
+    if (UsesVectorShading())
+        vectorEnd = ActiveKernels().shadeRows(MakeShadeParams(*this, lightX, lightY), field, pitch,
+                                              img.pixels, img.pitch, x0, y0, x1, y1);
+
+    for (int y = y0; y < y1; ++y) {
+        Rgba8 *row = img.pixels + (size_t)y * img.pitch;
+        const float *hN = field + idx(0, y - 1);
+        const float *hC = field + idx(0, y);
+        const float *hS = field + idx(0, y + 1);
+        for (int x = vectorEnd; x < x1; ++x) {
+            float dx = hC[x + 1] - hC[x - 1];
+            float dy = hS[x] - hN[x];
+            row[x] = lut ? ShadeLut(dx, dy) : ShadeGradient(dx, dy, lightX, lightY);
+        }
+    }
+}
+
+// --- Display-resolution rendering ---
+void LiquidSim::RenderUpsampled(RGBA8Span img, float lightX, float lightY) {
+    bool interpolate = BeginRender(lightX, lightY);
+    const float *field = interpolate ? heightRender.data() : heightField.data();
+
+    if (gradientX.size() != heightField.size()) {
+        gradientX.assign(heightField.size(), 0.0f);
+        gradientY.assign(heightField.size(), 0.0f);
+        std::fill(tileDirty.begin(), tileDirty.end(), 1);
+    }
+    if (img.width != upsampledWidth || img.height != upsampledHeight) {
+        // Output column -> left sim column and weight, padded by the widest
+        // vector so row passes can start anywhere. Sample positions are clamped
+        // to interior cells, which have gradients.
+        upsampleColumn.assign(img.width + SimKernels::maxWidth, 1);
+        upsampleWeight.assign(img.width + SimKernels::maxWidth, 0.0f);
+        for (int ox = 0; ox < img.width; ++ox) {
+            float sx = std::min(std::max((ox + 0.5f) * width / img.width - 0.5f, 1.0f),
+                                (float)(width - 2));
+            int x0 = std::min((int)sx, width - 3);
+            upsampleColumn[ox] = x0;
+            upsampleWeight[ox] = sx - x0;
+        }
+        upsampledWidth = img.width;
+        upsampledHeight = img.height;
+        std::fill(tileDirty.begin(), tileDirty.end(), 1);
+    }
+
+    // Gradient cells to refresh, as one column span per row: each dirty
+    // tile plus a one-cell ring, since a gradient reads its neighbours.
+    gradientSpan.assign(height, { width, 0 });
+    for (int t = 0; t < tilesX * tilesY; ++t) {
+        if (!tileDirty[t])
+            continue;
+        tileDirty[t] = 0;
+        int x0, y0, x1, y1;
+        TileBounds(t, x0, y0, x1, y1);
+        x0 = std::max(x0 - 1, 1);
+        x1 = std::min(x1 + 1, width - 1);
+        for (int y = std::max(y0 - 1, 1); y < std::min(y1 + 1, height - 1); ++y) {
+            gradientSpan[y].x0 = std::min(gradientSpan[y].x0, x0);
+            gradientSpan[y].x1 = std::max(gradientSpan[y].x1, x1);
+        }
+    }
+
+    if (interpolate) {
+        // Blend every height row a refreshed gradient row reads.
+        pool->ParallelFor(0, height, [&](int y0, int y1) {
+            for (int y = y0; y < y1; ++y) {
+                bool used = false;
+                for (int r = std::max(y - 1, 0); r <= std::min(y + 1, height - 1); ++r)
+                    used |= gradientSpan[r].x0 < gradientSpan[r].x1;
+                if (!used)
+                    continue;
+                for (int x = 0; x < width; ++x) {
+                    size_t i = idx(x, y);
+                    heightRender[i] = heightBack[i] + (heightField[i] - heightBack[i]) * renderAlpha;
+                }
+            }
+        }, minRowsPerBand);
+    }
+
+    pool->ParallelFor(1, height - 1, [&](int y0, int y1) {
+        for (int y = y0; y < y1; ++y) {
+            const float *hN = field + idx(0, y - 1);
+            const float *hC = field + idx(0, y);
+            const float *hS = field + idx(0, y + 1);
+            float *gx = gradientX.data() + idx(0, y);
+            float *gy = gradientY.data() + idx(0, y);
+            for (int x = gradientSpan[y].x0; x < gradientSpan[y].x1; ++x) {
+                gx[x] = hC[x + 1] - hC[x - 1];
+                gy[x] = hS[x] - hN[x];
+            }
+        }
+    }, minRowsPerBand);
+
+    // Output pixels that read a refreshed gradient: per output row, the
+    // columns whose two source cells overlap either source row's span.
+    upsampleSpan.assign(img.height, { 0, 0 });
+    const int *columns = upsampleColumn.data();
+    for (int oy = 0; oy < img.height; ++oy) {
+        int y0, y1;
+        float fy;
+        UpsampleSourceRows(oy, img.height, y0, y1, fy);
+        int cx0 = std::min(gradientSpan[y0].x0, gradientSpan[y1].x0);
+        int cx1 = std::max(gradientSpan[y0].x1, gradientSpan[y1].x1);
+        if (cx0 >= cx1)
+            continue;
+        upsampleSpan[oy].x0 = (int)(std::lower_bound(columns, columns + img.width, cx0 - 1) - columns);
+        upsampleSpan[oy].x1 = (int)(std::lower_bound(columns, columns + img.width, cx1) - columns);
+    }
+
+    pool->ParallelFor(0, img.height, [&](int oy0, int oy1) {
+        UpsampleRows(img, oy0, oy1, lightX, lightY);
+    }, 8);
+
+    dirtyRects.clear();
+    for (int oy = 0; oy < img.height; ++oy) {
+        const Span &span = upsampleSpan[oy];
+        if (span.x0 >= span.x1)
+            continue;
+        DirtyRect *last = dirtyRects.empty() ? nullptr : &dirtyRects.back();
+        if (last && last->y + last->h == oy && last->x == span.x0 && last->w == span.x1 - span.x0)
+            ++last->h;
+        else
+            dirtyRects.push_back({ span.x0, oy, span.x1 - span.x0, 1 });
+    }
+}
+
+void LiquidSim::UpsampleSourceRows(int oy, int outHeight, int &y0, int &y1, float &fy) const {
+    float sy = std::min(std::max((oy + 0.5f) * height / outHeight - 0.5f, 1.0f),
+                        (float)(height - 2));
+    y0 = std::min((int)sy, height - 3);
+    y1 = y0 + 1;
+    fy = sy - y0;
+}
+
+void LiquidSim::UpsampleRows(RGBA8Span img, int oy0, int oy1, float lightX, float lightY) const {
+    bool lut = UsesShadeLut();
+    bool vectorShade = UsesVectorShading();
+    const SimKernels &kernels = ActiveKernels();
+    const ShadeParams shade = MakeShadeParams(*this, lightX, lightY);
+    const int *column = upsampleColumn.data();
+    const float *weight = upsampleWeight.data();
+
+    // Gradient rows widened to output columns. Consecutive output rows
+    // mostly share their source rows, so each widened row is reused until
+    // the source row or the span changes.
+    struct WideRow {
+        int y = -1;
+        Span span = { 0, 0 };
+        std::vector<float> gx, gy;
+    };
+    WideRow rows[2];
+    for (WideRow &r : rows) {
+        r.gx.assign(img.width + SimKernels::maxWidth, 0.0f);
+        r.gy.assign(img.width + SimKernels::maxWidth, 0.0f);
+    }
+    auto widen = [&](WideRow &r, int y, Span span) {
+        if (r.y == y && r.span.x0 == span.x0 && r.span.x1 == span.x1)
+            return;
+        const float *gx = gradientX.data() + idx(0, y);
+        const float *gy = gradientY.data() + idx(0, y);
+        if (simdShade) {
+            kernels.widenRow(gx, column, weight, r.gx.data(), span.x0, span.x1);
+            kernels.widenRow(gy, column, weight, r.gy.data(), span.x0, span.x1);
+        } else {
+            for (int x = span.x0; x < span.x1; ++x) {
+                r.gx[x] = gx[column[x]] + (gx[column[x] + 1] - gx[column[x]]) * weight[x];
+                r.gy[x] = gy[column[x]] + (gy[column[x] + 1] - gy[column[x]]) * weight[x];
+            }
+        }
+        r.y = y;
+        r.span = span;
+    };
+
+    for (int oy = oy0; oy < oy1; ++oy) {
+        Span span = upsampleSpan[oy];
+        if (span.x0 >= span.x1)
+            continue;
+        int y0, y1;
+        float fy;
+        UpsampleSourceRows(oy, img.height, y0, y1, fy);
+        if (rows[1].y == y0 && rows[1].span.x0 == span.x0 && rows[1].span.x1 == span.x1)
+            std::swap(rows[0], rows[1]);
+        widen(rows[0], y0, span);
+        widen(rows[1], y1, span);
+
+        Rgba8 *out = img.pixels + (size_t)oy * img.pitch;
+        const WideRow &a = rows[0];
+        const WideRow &b = rows[1];
+        if (vectorShade) {
+            kernels.upsampleRow(shade, a.gx.data(), a.gy.data(), b.gx.data(), b.gy.data(), fy,
+                                out, span.x0, span.x1);
+            continue;
+        }
+        for (int x = span.x0; x < span.x1; ++x) {
+            float dx = a.gx[x] + (b.gx[x] - a.gx[x]) * fy;
+            float dy = a.gy[x] + (b.gy[x] - a.gy[x]) * fy;
+            out[x] = lut ? ShadeLut(dx, dy) : ShadeGradient(dx, dy, lightX, lightY);
+        }
+    }
+}
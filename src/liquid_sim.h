@@ -0,0 +1,473 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "environment.h"
+#include "huge_pages.h"
+#include "mpsc_queue.h"
+#include "rgba8.h"
+
+class ThreadPool;
+
+// Height-field wave solver with chrome shading. No windowing or graphics
+// dependencies; front ends upload the RGBA8 output themselves.
+struct LiquidSim {
+    // --- Grid layout ---
+    // Cells x in [0, width) of row y live at idx(x, y) = y * pitch + x.
+    // The outer ring (rows 0 and height - 1, columns 0 and width - 1) is
+    // the ghost layer that holds the boundary; only interior cells are
+    // simulated. pitch is width rounded up to fieldAlignment, and fields
+    // are allocated on that alignment, so every row starts on a cache line
+    // and a whole row is a run of full vectors.
+    //
+    // Full-row kernels therefore sweep x in [0, pitch) without tails or
+    // bounds checks, overwriting the ghost columns and the padding past
+    // width - 1, and ApplyBoundaryRows() then restores them from the
+    // boundary policy. Nothing reads the padding.
+    //
+    // Cell offsets are size_t, so grids past 46k x 46k (2^31 cells) work;
+    // width, height and pitch stay int. Fields of 2 MB and more can live on
+    // huge pages, see SetHugePages().
+    static constexpr int fieldAlignment = 64;
+    typedef std::vector<float, HugePageAllocator<float, fieldAlignment>> Field;
+    static constexpr int PitchFor(int w) {
+        return (w + fieldAlignment / 4 - 1) / (fieldAlignment / 4) * (fieldAlignment / 4);
+    }
+
+    int width;
+    int height;
+    int pitch;
+    float stiffness;
+    float damping;
+    Field heightField;
+    Field velocityField;
+
+    // Ping-pong partner of heightField for the fused step. Its ghost cells
+    // hold the boundary like heightField's, so the two can be swapped
+    // freely.
+    Field heightBack;
+
+    enum class StepMode {
+        TwoPass, // force pass, then damp/integrate pass (original layout)
+        Fused    // one pass from heightField into heightBack, then swap
+    };
+    StepMode stepMode = StepMode::Fused;
+
+    // Use the SIMD kernels in Step(); StepScalar() stays as the reference.
+    bool simdStep = true;
+
+    // SIMD fused step over full rows [y0, y1) of planes with the given
+    // pitch (ghost cells included, see ApplyBoundaryRows()); h, v and out
+    // point at row 0. The constructor picks a kernel built for the exact
+    // width when one is prebuilt (fixedKernelWidths), so the compiler knows
+    // the trip count and unrolls the row; otherwise FusedRowsGeneric. Both
+    // give the same results. Sparse tiles keep the per-tile kernel. The
+    // kernels come from the instruction-set variant picked at startup
+    // (sim_kernels.h).
+    typedef void (*FusedRowsFn)(const float *h, float *v, float *out, int pitch,
+                                int y0, int y1, float k);
+    static constexpr int fixedKernelWidths[4] = { 256, 512, 1024, 2048 };
+    FusedRowsFn fusedRows;
+    static FusedRowsFn FusedRowsFor(int width);
+    static void FusedRowsGeneric(const float *h, float *v, float *out, int pitch,
+                                 int y0, int y1, float k);
+
+    // --- Boundary ---
+    // What the ghost layer holds after every step:
+    //   Fixed      zero: reflecting walls with the edge pinned (original).
+    //   Free       a copy of the adjacent interior cell (zero normal
+    //              derivative): reflecting walls the surface slides along.
+    //   Periodic   a copy of the opposite interior edge, so waves wrap
+    //              around. Advance() does not block temporally with it.
+    //   Absorbing  Free ghosts plus a sponge band spongeWidth cells wide
+    //              whose heights and velocities are scaled by
+    //              1 - spongeStrength * r^2 each step, r rising from 0 at
+    //              the inner edge of the band to 1 at the wall, so waves
+    //              die out in the band instead of reflecting.
+    // Ghost columns and the sponge are applied row by row inside each
+    // kernel band, the sponge as vector passes over only the band's
+    // columns; the two ghost rows take one pass after the step. Sparse
+    // tiles damp their own cells and the ghost columns are refreshed after
+    // the tile pass, so no policy adds a full-grid pass.
+    enum class Boundary { Fixed, Free, Periodic, Absorbing };
+    Boundary boundary = Boundary::Fixed;
+    int spongeWidth = 32;
+    float spongeStrength = 0.15f;
+    std::vector<float> spongeColumn;  // per column, padded to pitch
+    std::vector<float> spongeRow;     // per row
+    int spongeBuiltWidth = 0;
+    float spongeBuiltStrength = 0.0f;
+
+    // Rebuilds the sponge profile after spongeWidth or spongeStrength
+    // changed; Step() and Advance() call it.
+    void PrepareBoundary();
+
+    // The helpers take planes with the field's pitch whose first row is
+    // row firstRow of the grid (0 for the fields themselves, the halo
+    // start for temporal scratch). ApplyBoundaryRows() damps rows
+    // [y0, y1) and restores their ghost columns and padding after a
+    // full-row kernel wrote them; ApplyGhostRows() refreshes ghost rows 0
+    // and height - 1 when the plane holds them and their source rows.
+    void ApplyBoundaryRows(float *h, float *v, int firstRow, int y0, int y1) const;
+    void ApplyGhostColumns(float *h, float *v, int firstRow, int y0, int y1) const;
+    void ApplySponge(float *h, float *v, int firstRow, int x0, int y0, int x1, int y1) const;
+    void ApplyGhostRows(float *h, int firstRow, int lastRow) const;
+
+    // Refreshes the ghosts copied from interior cells [x0, x1) x [y0, y1)
+    // after input wrote them (AddImpulse(), FlushStrokes()), so the next
+    // step reads the new edge values.
+    void RefreshInputGhosts(int x0, int y0, int x1, int y1);
+
+    // --- Reduced-precision storage ---
+    // Half and Fixed16 keep heights, previous heights and velocities in 16
+    // bits per cell (packedHeight, packedBack, packedVelocity), which halves
+    // the bytes a step streams. Stepping widens each vector to 32-bit lanes
+    // and narrows the results on store:
+    //   Half     IEEE binary16, F16C conversions in the avx2 and avx512
+    //            kernels; the arithmetic is the fp32 kernel's.
+    //   Fixed16  signed fixed point, heights with fixedFractionBits (Q4.11
+    //            by default: +-16 in steps of 1/2048) and velocities with
+    //            fixedVelocityExtraBits more (Q2.13: +-4), integrated in
+    //            int32 lanes with Q14 stiffness and damping. The finer
+    //            velocity unit lets a gentle slope still produce a force,
+    //            so smooth swells keep settling instead of freezing once
+    //            k * curvature drops below one height unit. Velocities and
+    //            heights saturate to the int16 range; damping rounds toward
+    //            zero, so a quiet surface decays to rest instead of cycling
+    //            on the last bit. stiffness must stay <= 0.5 (the fp32
+    //            stability limit too): the kernel clamps it there to keep
+    //            its products in int32, and SetStorage() asserts it.
+    // Packed grids step dense and fused with the SIMD kernels (sparse
+    // tiles, temporal blocking, StepMode and simdStep are fp32 only), with
+    // the same boundary policies. heightField becomes the decoded view:
+    // SyncHeights() refreshes it (and heightBack, with keepPreviousHeights),
+    // and rendering does so itself. The fp32 velocity planes are released.
+    // Input is applied to the packed heights directly.
+    //
+    // Change storage through SetStorage(), which converts the state; set
+    // fixedFractionBits before switching to Fixed16.
+    enum class Storage { Float32, Half, Fixed16 };
+    typedef std::vector<uint16_t, HugePageAllocator<uint16_t, fieldAlignment>> PackedField;
+    Storage storage = Storage::Float32;
+    int fixedFractionBits = 11;
+    static constexpr int fixedVelocityExtraBits = 2;
+    PackedField packedHeight;
+    PackedField packedBack;
+    PackedField packedVelocity;
+    bool packedDirty = false;  // heightField lags packedHeight
+
+    void SetStorage(Storage s);
+    void SyncHeights();
+    void StepPacked();
+    int VelocityFractionBits() const { return fixedFractionBits + fixedVelocityExtraBits; }
+    // fractionBits only applies to Fixed16.
+    void DecodeRow(const uint16_t *in, float *out, size_t n, int fractionBits) const;
+    void EncodeRow(const float *in, uint16_t *out, size_t n, int fractionBits) const;
+    void ApplyBoundaryRows(uint16_t *h, uint16_t *v, int y0, int y1) const;
+    void ApplyGhostRows(uint16_t *h) const;
+
+    // Adds a * w[i] to n cells starting at (x0, y) in whichever storage is
+    // active; shared by AddImpulse() and FlushStrokes().
+    void AddToHeights(int x0, int y, int n, float a, const float *w);
+
+    // Temporal blocking for Advance(): each row tile plus a K-row halo is
+    // copied into per-thread scratch, advanced K steps there (the halo
+    // shrinks by one row per step) and only the tile rows are written back.
+    // Tiles are sized so the scratch fits in tileCacheBytes, which makes K
+    // steps cost about one pass of DRAM traffic.
+    //
+    // That only pays once the fields no longer stay in the last-level
+    // cache between steps; below that the copies and halo recomputation
+    // make blocking slower. Advance() therefore only blocks grids whose
+    // height and velocity fields together take at least temporalMinBytes.
+    // Measured with K = 4 (dense, one thread, 2 MB L2): 2048^2 (32 MB)
+    // takes 4.0 ns/cell blocked against 3.0 unblocked, 2560^2 (50 MB) is
+    // about even, and 3072^2 (72 MB) takes 4.5 against 5.9.
+    bool temporalBlocking = true;
+    int temporalDepth = 4;
+    int tileCacheBytes = 1 << 20;
+    size_t temporalMinBytes = size_t(56) << 20;
+    Field velocityBack;
+
+    // Whether Advance() may block temporally with the current settings,
+    // size and storage (awake tiles and the steps left are checked per
+    // chunk).
+    bool UsesTemporalBlocking() const;
+
+    // Sparse activity tracking. The grid is split into activeTileSize^2
+    // tiles; after each fused step and each temporal chunk of Advance() a
+    // tile whose max |h| and |v| are both below sleepEpsilon is snapped to
+    // rest and put to sleep. Step() only
+    // visits awake tiles and their 8 neighbours (so waves can spread into
+    // sleeping tiles), and RenderToImage() only re-shades tiles that changed.
+    // AddImpulse() wakes the tiles it touches. Code that edits the fields
+    // directly must call WakeAllTiles().
+    //
+    // Invariant: a tile that is neither awake nor next to an awake tile is
+    // exactly zero in heightField, heightBack and velocityField.
+    //
+    // Heights below 1e-3 move the shaded colour by at most one 8-bit step,
+    // so snapping such tiles to rest is not visible.
+    static constexpr int activeTileSize = 32;
+    bool sparseTiles = true;
+    float sleepEpsilon = 1e-3f;
+    // Whether Step() visits awake tiles only: sparseTiles with the fused
+    // fp32 kernel (packed grids and two-pass steps are dense).
+    bool UsesSparseTiles() const;
+    int tilesX = 0;
+    int tilesY = 0;
+    std::vector<unsigned char> tileAwake;
+    std::vector<unsigned char> tileDirty;
+    std::vector<float> tileMaxHeight;
+    std::vector<float> tileMaxVelocity;
+    std::vector<int> activeTiles;
+    // Per row and tile column, the max |h| and |v| a temporal chunk wrote.
+    std::vector<float> rowTileMaxHeight;
+    std::vector<float> rowTileMaxVelocity;
+    float renderedLightX = 0.0f;
+    float renderedLightY = 0.0f;
+
+    // Render-time interpolation for fixed-timestep front ends. With
+    // keepPreviousHeights set, heightBack always holds the heights from
+    // before the most recent step (the fused paths leave it there for free,
+    // the two-pass path copies it first, and Advance() ends on a single
+    // step), and RenderToImage() shades
+    //   lerp(heightBack, heightField, renderAlpha).
+    // tileStepped marks the tiles the last step touched; only those need
+    // re-shading when renderAlpha changes.
+    bool keepPreviousHeights = false;
+    float renderAlpha = 1.0f;
+    float renderedAlpha = 1.0f;
+    std::vector<unsigned char> tileStepped;
+    Field heightRender;
+
+    // Pixel rectangles re-shaded by the last RenderToImage() call: one per
+    // run of tile rows with the same dirty column span.
+    struct DirtyRect { int x, y, w, h; };
+    std::vector<DirtyRect> dirtyRects;
+
+    // Interior rows are split into one band per pool thread. Bands shorter
+    // than this are not worth waking a worker for.
+    int minRowsPerBand = 16;
+    std::unique_ptr<ThreadPool> pool;
+
+    // threads <= 0 uses the hardware concurrency.
+    LiquidSim(int w, int h, int threads = 0);
+    ~LiquidSim();
+
+    void SetThreadCount(int threads);
+    int ThreadCount() const;
+
+    // Kernel variant in use (scalar, sse4.2, avx2 or avx512), picked from
+    // the CPU at startup or forced with MLIQUIDMETAL_KERNELS.
+    static const char *SimdName();
+
+    size_t idx(int x, int y) const { return (size_t)y * pitch + x; }
+
+    // Adds amount * exp(-d^2 / 2) to the interior cells within radius of
+    // (x, y) on both axes. Falloff values below FLT_MIN (|d| > 13.2) are
+    // flushed to 0: they could only move a cell sitting at exactly 0, by
+    // less than 1e-37, and as denormals they slowed down both this loop
+    // and the solver. Radii past impulseSupport are therefore clipped with
+    // no further change.
+    //
+    // Each effective radius caches its stamp plus, per stamp row, the
+    // half-width of its nonzero columns. A call clips that against the
+    // interior once per row and adds a vector at a time; results match the
+    // per-cell exp() loop exactly outside the flushed cells.
+    //
+    // separableImpulse uses the row weight times the 1D kernel,
+    // exp(-j^2 / 2) * exp(-i^2 / 2), over the same extents instead of the
+    // 2D stamp; it can differ in the last bit.
+    struct ImpulseKernel {
+        std::vector<float> stamp;    // (2r+1)^2, row-major
+        std::vector<float> weights;  // 2r+1
+        std::vector<int> halfWidth;  // per stamp row, -1 if all zero
+    };
+    static constexpr int impulseSupport = 13;
+    bool separableImpulse = false;
+    std::vector<ImpulseKernel> impulseKernels;  // indexed by radius
+    void AddImpulse(int x, int y, float amount, int radius = 3);
+    const ImpulseKernel &GetImpulseKernel(int radius);
+
+    // --- Strokes ---
+    // QueueStroke() samples the segment (x0, y0) -> (x1, y1), in fractional
+    // cell coordinates, every strokeSpacing cells and queues a Gaussian
+    // stamp (the AddImpulse() falloff, centred at the fractional position)
+    // per sample. amount is deposited per cell of path length, so a drag
+    // leaves an even line whatever its speed; a segment shorter than one
+    // cell deposits amount in total. The start point is left to the
+    // previous segment, so consecutive segments do not double up.
+    //
+    // FlushStrokes() applies every queued stamp in one pass over the rows
+    // they cover, in parallel bands. The falloff is separable, so a stamp
+    // is a row weight times a column weight, both read from
+    // strokeKernel (exp(-t^2 / 2) at 1/strokeKernelSteps steps, linearly
+    // interpolated) instead of calling exp per cell. Step() and Advance()
+    // flush first.
+    struct Stamp {
+        float amount;
+        int x0, y0, x1, y1;  // clipped cell rectangle, exclusive end
+        size_t weights;      // (x1 - x0) column then (y1 - y0) row weights
+    };
+    static constexpr int strokeKernelSteps = 64;
+    float strokeSpacing = 0.5f;
+    std::vector<float> strokeKernel;
+    std::vector<Stamp> stamps;
+    std::vector<float> stampWeights;
+
+    void QueueStroke(float x0, float y0, float x1, float y1, float amount, int radius = 3);
+    void QueueStamp(float x, float y, float amount, int radius);
+    void FlushStrokes();
+    void AddStroke(float x0, float y0, float x1, float y1, float amount, int radius = 3);
+    float StrokeFalloff(float t) const;
+
+    // --- Posted input ---
+    // PostStroke() and PostImpulse() may be called from any thread (network,
+    // sensors, scripted drivers) while the sim runs. They go through a
+    // bounded lock-free queue, so a producer never blocks: when the queue
+    // is full the input is dropped and false is returned. Step() and
+    // Advance() drain everything posted so far into the stroke queue and
+    // apply it together with any QueueStroke() stamps in one FlushStrokes()
+    // pass. Every other member stays single-threaded.
+    struct PostedStroke {
+        float x0, y0, x1, y1;
+        float amount;
+        int radius;
+    };
+    static constexpr int postedCapacity = 4096;
+    MpscQueue<PostedStroke> posted{ postedCapacity };
+
+    bool PostStroke(float x0, float y0, float x1, float y1, float amount, int radius = 3);
+    bool PostImpulse(float x, float y, float amount, int radius = 3) {
+        return PostStroke(x, y, x, y, amount, radius);
+    }
+    // Drains posted input and flushes all queued stamps.
+    void ApplyPendingInput();
+
+    // Wakes every tile overlapping cells [x0, x1) x [y0, y1).
+    void WakeTiles(int x0, int y0, int x1, int y1);
+    void WakeAllTiles();
+    int AwakeTileCount() const;
+
+    void Step();
+
+    // Runs several steps, temporally blocked in chunks of temporalDepth when
+    // UsesTemporalBlocking(). The blocked path always uses the fused kernel and matches
+    // repeated fused Step() calls exactly. While most of the surface is
+    // asleep, per-step sparse updates are cheaper than dense blocking; each
+    // chunk puts the tiles that settled back to sleep, so a quiet surface
+    // returns to them.
+    void Advance(int steps);
+
+    void StepScalar();
+    void StepSimd();
+    void StepForceRows(int y0, int y1);
+    void StepIntegrateRows(int y0, int y1);
+    void StepFused();
+    void StepFusedSparse();
+    void StepTile(int t);
+    void StepTemporal(int k);
+    void StepTemporalTile(int y0, int y1, int k);
+    void SettleTemporalTiles();
+    int TemporalTileRows(int k) const;
+
+    void TileBounds(int t, int &x0, int &y0, int &x1, int &y1) const;
+    void ClearTile(Field &field, int t);
+
+    // Shade a vector of pixels per iteration in RenderToImage(). Everything
+    // but the chrome curve is computed exactly as in the scalar path; the
+    // 0.6 power comes from a 4096-step table, which changes a channel by at
+    // most one 8-bit step except in near-black pixels (intensity < 0.01, up
+    // to two).
+    bool simdShade = true;
+
+    // Optional LUT shading. The final colour depends only on the central
+    // differences (dx, dy) and the light, so it is tabulated on a
+    // shadeLutSize^2 grid over [-shadeLutRange, shadeLutRange]^2 (nearest
+    // bin, gradients outside the range clamp to the edge) and each pixel is
+    // two subtractions plus one lookup. The table is rebuilt when the light
+    // changes or InvalidateShading() is called. It is only used when
+    // lutShade is set.
+    //
+    // Error against exact shading with the flat faces: at most 2 per
+    // channel over the range, except where a pixel is within half a bin
+    // (range / 256 = 0.008) of a cubemap face boundary (|dx| = |dy| or
+    // |dx|, |dy| = 1) and picks the neighbouring face colour. A textured
+    // environment also varies inside a bin, so the error grows with its
+    // contrast: up to 44 per channel on the bench's --env panorama, with
+    // 2% of gradients over 2.
+    //
+    // Without the LUT, the SIMD kernels shade the flat faces exactly;
+    // textured environments are shaded per pixel by ShadeGradient(), which
+    // samples the cubemap through Environment::Sample().
+    static constexpr int shadeLutSize = 256;
+    bool lutShade = false;
+    float shadeLutRange = 2.0f;
+    std::vector<Rgba8> shadeLut;
+    float shadeLutLightX = 0.0f;
+    float shadeLutLightY = 0.0f;
+
+    // --- Cubemap reflection ---
+    // Starts as the original six flat face colours. Set it with
+    // SetEnvironment(); call InvalidateShading() after changing
+    // environmentLod (0 = sharp, higher mips look rougher).
+    Environment environment;
+    float environmentLod = 0.0f;
+
+    void SetEnvironment(Environment env);
+    bool UsesShadeLut() const { return lutShade; }
+    // Whether the SIMD shading kernels apply: the LUT, or the flat faces.
+    bool UsesVectorShading() const { return simdShade && (lutShade || environment.IsFlat()); }
+    Rgba8 SampleCubemap(float nx, float ny, float nz) const;
+
+    // Scalar shading of one pixel from its central differences.
+    Rgba8 ShadeGradient(float dx, float dy, float lightX, float lightY) const;
+    Rgba8 ShadeLut(float dx, float dy) const;
+
+    // Forces the shading LUT to be rebuilt and every tile to be re-shaded,
+    // e.g. after the environment changes.
+    void InvalidateShading();
+    void BuildShadeLut(float lightX, float lightY);
+
+    // Shades the interior into img, which must be width x height. Only
+    // tiles that changed since the last call are re-shaded (all of them if
+    // the light moved), and their bounds are recorded in dirtyRects. Border
+    // pixels are never written. (lightX, lightY, 1) is the light direction.
+    // See keepPreviousHeights for renderAlpha.
+    void RenderToImage(RGBA8Span img, float lightX, float lightY);
+    void RenderRect(RGBA8Span img, const float *field, float lightX, float lightY,
+                    int x0, int y0, int x1, int y1) const;
+
+    // Light, alpha and LUT bookkeeping shared by both render paths; returns
+    // whether heights are interpolated into heightRender.
+    bool BeginRender(float lightX, float lightY);
+
+    // --- Display-resolution rendering ---
+    // RenderUpsampled() shades an image of any size (typically the window)
+    // from the sim grid, bilinear in the normals instead of blocky.
+    // Central differences are computed once per sim cell into gradientX/Y.
+    // Each gradient row is then widened to output columns once and reused
+    // by every output row between it and the next source row, so per output
+    // pixel the work is one vertical blend plus shading, a vector of
+    // pixels at a time, with output rows shaded in parallel. Only the spans
+    // of output rows whose source cells changed are redrawn and recorded in
+    // dirtyRects. Sample positions are clamped to interior cells, which
+    // have gradients. Use either this or RenderToImage() on one sim, since
+    // both consume tileDirty.
+    struct Span { int x0, x1; };
+    Field gradientX;
+    Field gradientY;
+    std::vector<Span> gradientSpan;    // per sim row: cells refreshed
+    std::vector<Span> upsampleSpan;    // per output row: pixels redrawn
+    std::vector<int> upsampleColumn;   // per output column, padded by SimKernels::maxWidth
+    std::vector<float> upsampleWeight;
+    int upsampledWidth = 0;
+    int upsampledHeight = 0;
+
+    void RenderUpsampled(RGBA8Span img, float lightX, float lightY);
+    void UpsampleSourceRows(int oy, int outHeight, int &y0, int &y1, float &fy) const;
+    void UpsampleRows(RGBA8Span img, int oy0, int oy1, float lightX, float lightY) const;
+};
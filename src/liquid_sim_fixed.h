@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+
+#include "half.h"
+#include "liquid_sim.h"
+
+// LiquidSim with its grid size and storage type checked and named at
+// compile time.
+//
+// This is a size-checked alias, not a separate solver: it is a LiquidSim
+// constructed as LiquidSim(W, H), so rendering, strokes, posted input and
+// SimPipeline work unchanged, and the generated step code is the same as
+// for a runtime-sized LiquidSim of that width. Widths listed in
+// LiquidSim::fixedKernelWidths step with the width-specialized kernel
+// (kFixedKernel says so at compile time, e.g. for a static_assert); other
+// sizes compile but step with the generic kernel. The dimensions are
+// constant expressions, and CellIndex() is idx() with the constant pitch.
+//
+// T is the per-cell storage type and selects LiquidSim::Storage:
+//   float     Float32
+//   Float16   Half (binary16, see half.h)
+//   int16_t   Fixed16, with the default fixedFractionBits
+// The 16-bit types step with the packed kernels rather than the
+// width-specialized one. Other types do not compile.
+template <typename T>
+struct FixedStorage;
+template <>
+struct FixedStorage<float> { static constexpr LiquidSim::Storage value = LiquidSim::Storage::Float32; };
+template <>
+struct FixedStorage<Float16> { static constexpr LiquidSim::Storage value = LiquidSim::Storage::Half; };
+template <>
+struct FixedStorage<int16_t> { static constexpr LiquidSim::Storage value = LiquidSim::Storage::Fixed16; };
+
+template <int W, int H, typename T = float>
+struct LiquidSimFixed : LiquidSim {
+    static_assert(W >= 3 && H >= 3, "the grid needs an interior");
+
+    typedef T Scalar;
+    static constexpr Storage kStorage = FixedStorage<T>::value;
+    static constexpr int kWidth = W;
+    static constexpr int kHeight = H;
+    static constexpr int kPitch = PitchFor(W);
+    static constexpr size_t kCells = (size_t)H * kPitch;  // per plane, padding included
+    static constexpr bool kFixedKernel =
+        kStorage == Storage::Float32 &&
+        (W == fixedKernelWidths[0] || W == fixedKernelWidths[1] ||
+         W == fixedKernelWidths[2] || W == fixedKernelWidths[3]);
+
+    explicit LiquidSimFixed(int threads = 0) : LiquidSim(W, H, threads) {
+        SetStorage(kStorage);
+    }
+
+    static constexpr size_t CellIndex(int x, int y) { return (size_t)y * kPitch + x; }
+};
+
+typedef LiquidSimFixed<256, 256> LiquidSim256;
+typedef LiquidSimFixed<512, 512> LiquidSim512;
+typedef LiquidSimFixed<1024, 1024> LiquidSim1024;
+typedef LiquidSimFixed<2048, 2048> LiquidSim2048;
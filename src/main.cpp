@@ -1,156 +1,196 @@
 #include "raylib.h"
 #include "raymath.h"
+#include <algorithm>
 #include <vector>
 #include <cmath>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <utility>
+#include "liquid_sim.h"
+#include "sim_pipeline.h"
+#include "frame_profiler.h"
+
+// The solver writes RGBA8 straight into Image data.
+static_assert(sizeof(Color) == sizeof(Rgba8), "Color must be packed RGBA8");
+
+// Stroke state of one pointer: a touch contact id (or kMousePointer) and
+// where its last stroke segment ended, in sim cells.
+struct PointerStroke {
+    int id;
+    Vector2 last;
+};
 
-struct LiquidSim {
-    int width;
-    int height;
-    float stiffness;
-    float damping;
-    std::vector<float> heightField;
-    std::vector<float> velocityField;
-
-    LiquidSim(int w, int h)
-        : width(w), height(h),
-          stiffness(0.2f), damping(0.985f),
-          heightField(w * h, 0.0f),
-          velocityField(w * h, 0.0f) {}
-
-    int idx(int x, int y) const { return y * width + x; }
-
-    void AddImpulse(int x, int y, float amount, int radius = 3) {
-        for (int j = -radius; j <= radius; ++j) {
-            for (int i = -radius; i <= radius; ++i) {
-                int nx = x + i;
-                int ny = y + j;
-                if (nx > 0 && nx < width - 1 && ny > 0 && ny < height - 1) {
-                    float dist2 = float(i * i + j * j);
-                    float falloff = std::exp(-dist2 * 0.5f);
-                    heightField[idx(nx, ny)] += amount * falloff;
-                }
-            }
+static const int kMousePointer = -1;
+
+// Uploads only the rectangles RenderToImage() touched. Sub-width
+// rectangles are packed into staging first since UpdateTextureRec() expects
+// tightly packed rows.
+static void UploadDirtyRects(Texture2D tex, const Image &img,
+                             const std::vector<LiquidSim::DirtyRect> &rects,
+                             std::vector<Color> &staging) {
+    const Color *pixels = (const Color *)img.data;
+    for (const LiquidSim::DirtyRect &r : rects) {
+        Rectangle rec = { (float)r.x, (float)r.y, (float)r.w, (float)r.h };
+        if (r.w == img.width) {
+            UpdateTextureRec(tex, rec, pixels + r.y * img.width);
+            continue;
         }
+        staging.resize((size_t)r.w * r.h);
+        for (int y = 0; y < r.h; ++y)
+            std::memcpy(&staging[(size_t)y * r.w], pixels + (r.y + y) * img.width + r.x,
+                        r.w * sizeof(Color));
+        UpdateTextureRec(tex, rec, staging.data());
     }
-
-    void Step() {
-        for (int y = 1; y < height - 1; ++y) {
-            for (int x = 1; x < width - 1; ++x) {
-                float center = heightField[idx(x, y)];
-                float sumNeighbors =
-                    heightField[idx(x - 1, y)] +
-                    heightField[idx(x + 1, y)] +
-                    heightField[idx(x, y - 1)] +
-                    heightField[idx(x, y + 1)];
-
-                float force = (sumNeighbors - 4.0f * center) * stiffness;
-                velocityField[idx(x, y)] += force;
-            }
-        }
-
-        for (int y = 1; y < height - 1; ++y) {
-            for (int x = 1; x < width - 1; ++x) {
-                //THIS IS WHERE DAMPING LIVES
-                
-                //Originally:
-                //velocityField[idx(x, y)] *= damping;
-                velocityField[idx(x, y)] *= 0.94f;
-                heightField[idx(x, y)] += velocityField[idx(x, y)];
-            }
+}
+
+// Loads the reflection environment named on the command line: one
+// latitude-longitude panorama, or six cubemap faces in +X -X +Y -Y +Z -Z
+// order. Any format raylib can load works.
+static bool LoadEnvironment(LiquidSim &sim, int count, char **paths) {
+    if (count != 1 && count != 6)
+        return false;
+
+    Image images[6] = {};
+    RGBA8View views[6] = {};
+    bool ok = true;
+    for (int i = 0; i < count; ++i) {
+        images[i] = LoadImage(paths[i]);
+        if (!images[i].data) {
+            ok = false;
+            continue;
         }
+        ImageFormat(&images[i], PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+        views[i] = { (const Rgba8 *)images[i].data, images[i].width, images[i].height, images[i].width };
     }
 
-    // --- Fake cubemap reflection ---
-    Color SampleCubemap(const Vector3 &n) {
-        // Define 6 cubemap face colors
-        Color envRight  = { 200, 180, 160, 255 }; // +X
-        Color envLeft   = { 160, 180, 200, 255 }; // -X
-        Color envUp     = { 180, 200, 255, 255 }; // +Y
-        Color envDown   = { 40, 40, 50, 255 };    // -Y
-        Color envFront  = { 120, 130, 150, 255 }; // +Z
-        Color envBack   = { 80, 70, 60, 255 };    // -Z
-
-        Color env;
-
-        // Pick dominant axis of normal
-        float ax = fabs(n.x);
-        float ay = fabs(n.y);
-        float az = fabs(n.z);
-
-        if (ax > ay && ax > az)
-            env = (n.x > 0) ? envRight : envLeft;
-        else if (ay > az)
-            env = (n.y > 0) ? envUp : envDown;
-        else
-            env = (n.z > 0) ? envFront : envBack;
-
-        return env;
+    Environment env;
+    if (ok)
+        ok = count == 1 ? env.LoadEquirect(views[0]) : env.LoadFaces(views);
+    for (int i = 0; i < count; ++i) {
+        if (images[i].data)
+            UnloadImage(images[i]);
+    }
+    if (ok) {
+        // Textured maps are shaded through the LUT by default for speed;
+        // "L" switches to exact per-pixel sampling.
+        sim.lutShade = true;
+        sim.SetEnvironment(std::move(env));
+    }
+    return ok;
+}
+
+// Rolling stage averages plus a frame-time graph (newest frame on the
+// right, one pixel per frame, the line marks 16.6 ms).
+static void DrawProfilerOverlay(const FrameProfiler &profiler, int x, int y) {
+    const int window = 120;
+    const int graphW = 240;
+    const int graphH = 60;
+    const float graphMaxMs = 33.3f;
+    const int lineH = 14;
+    const int stages = (int)ProfileStage::Count;
+
+    Color panel = { 0, 0, 0, 170 };
+    Color text = { 230, 230, 230, 255 };
+    DrawRectangle(x, y, graphW + 16, 8 + (stages + 1) * lineH + graphH + 12, panel);
+
+    float frameMs = profiler.AverageFrameMs(window);
+    DrawText(TextFormat("frame %6.2f ms  (%.0f fps)", frameMs, frameMs > 0.0f ? 1000.0f / frameMs : 0.0f),
+             x + 8, y + 6, 10, text);
+    for (int s = 0; s < stages; ++s) {
+        DrawText(TextFormat("%-8s %6.3f ms", ProfileStageName((ProfileStage)s),
+                            profiler.AverageStageMs((ProfileStage)s, window)),
+                 x + 8, y + 6 + (s + 1) * lineH, 10, text);
     }
 
-    void RenderToImage(Image &img, Vector2 lightDir) {
-        Color *pixels = (Color *)img.data;
-
-        for (int y = 1; y < height - 1; ++y) {
-            for (int x = 1; x < width - 1; ++x) {
-                float hL = heightField[idx(x - 1, y)];
-                float hR = heightField[idx(x + 1, y)];
-                float hU = heightField[idx(x, y - 1)];
-                float hD = heightField[idx(x, y + 1)];
-
-                float dx = hR - hL;
-                float dy = hD - hU;
-
-                Vector3 n = { -dx, -dy, 1.0f };
-                float len = std::sqrt(n.x*n.x + n.y*n.y + n.z*n.z);
-                if (len > 0.0f) {
-                    n.x /= len;
-                    n.y /= len;
-                    n.z /= len;
-                }
-
-                float ndotl = n.x * lightDir.x + n.y * lightDir.y + n.z * 1.0f;
-                float base = 0.4f;
-                float intensity = base + ndotl * 0.6f;
-                intensity = Clamp(intensity, 0.0f, 1.0f);
-
-                // Chrome brightness curve
-                float boosted = powf(intensity, 0.6f);
-                unsigned char chrome = (unsigned char)(boosted * 255.0f);
-
-                // Sample cubemap
-                Color env = SampleCubemap(n);
-
-                // Blend chrome with cubemap
-                unsigned char finalR = (unsigned char)(chrome * 0.4f + env.r * 0.6f);
-                unsigned char finalG = (unsigned char)(chrome * 0.4f + env.g * 0.6f);
-                unsigned char finalB = (unsigned char)(chrome * 0.4f + env.b * 0.6f);
-
-                // Semi-transparent chrome
-                pixels[idx(x, y)] = { finalR, finalG, finalB, 180 };
-            }
+    int gx = x + 8;
+    int gy = y + 8 + (stages + 1) * lineH + graphH;
+    int frames = profiler.Available() < graphW ? profiler.Available() : graphW;
+    for (int i = 0; i < frames; ++i) {
+        float ms = profiler.Recent(i).frameMs;
+        int h = (int)(Clamp(ms / graphMaxMs, 0.0f, 1.0f) * graphH);
+        Color bar = ms > 16.7f ? RED : GREEN;
+        DrawLine(gx + graphW - 1 - i, gy, gx + graphW - 1 - i, gy - h, bar);
+    }
+    int budgetY = gy - (int)(16.6f / graphMaxMs * graphH);
+    DrawLine(gx, budgetY, gx + graphW, budgetY, YELLOW);
+}
+
+// mLiquidMetal [--pipelined] [--walls fixed|free|periodic|absorbing]
+//              [panorama | +x -x +y -y +z -z]
+int main(int argc, char **argv) {
+
+    // --pipelined runs the solver on its own thread (see SimPipeline);
+    // sim below then only shades the snapshots it hands over. --walls
+    // picks the boundary; absorbing gives open water.
+    bool pipelined = false;
+    LiquidSim::Boundary walls = LiquidSim::Boundary::Fixed;
+    while (argc > 1 && !strncmp(argv[1], "--", 2)) {
+        if (!strcmp(argv[1], "--pipelined")) {
+            pipelined = true;
+        } else if (!strcmp(argv[1], "--walls") && argc > 2) {
+            const char *name = argv[2];
+            if (!strcmp(name, "free"))
+                walls = LiquidSim::Boundary::Free;
+            else if (!strcmp(name, "periodic"))
+                walls = LiquidSim::Boundary::Periodic;
+            else if (!strcmp(name, "absorbing"))
+                walls = LiquidSim::Boundary::Absorbing;
+            --argc;
+            ++argv;
         }
+        --argc;
+        ++argv;
     }
-};
-
-int main() {
 
     const int startWidth = 960;
     const int startHeight = 540;
 
     const int simWidth = 200;
     const int simHeight = 200;
+    const int substepsPerFrame = 1;
+
+    // Fixed simulation rate: the original tuning was one step per frame at
+    // 60 FPS. The accumulator keeps wave speed independent of the display
+    // rate, and maxStepsPerFrame stops a slow frame from snowballing into
+    // ever longer catch-up frames (the excess time is dropped instead).
+    const float simRate = 60.0f * substepsPerFrame;
+    const int maxStepsPerFrame = 8 * substepsPerFrame;
+    float simAccumulator = 0.0f;
 
     InitWindow(startWidth, startHeight, "mLiquidMetal by Paul Swonger (covidinsane@gmail.com)");
     SetWindowTitle("mLiquidMetal by Paul Swonger (covidinsane@gmail.com)");
-    SetTargetFPS(60);
+    int refreshRate = GetMonitorRefreshRate(GetCurrentMonitor());
+    SetTargetFPS(refreshRate > 0 ? refreshRate : 60);
 
     // Dark background for chrome contrast
     Color rayBlue = { 20, 40, 60, 255 };
 
-    LiquidSim sim(simWidth, simHeight);
+    int cores = (int)std::max(1u, std::thread::hardware_concurrency());
+    int simThreads = std::max(1, cores / 2);
+    LiquidSim sim(simWidth, simHeight, pipelined ? std::max(1, cores - simThreads) : 0);
+    sim.keepPreviousHeights = !pipelined;
+    sim.boundary = walls;
+
+    std::unique_ptr<SimPipeline> pipeline;
+    if (pipelined) {
+        pipeline.reset(new SimPipeline(simWidth, simHeight, simRate, simThreads));
+        pipeline->maxCatchUpSteps = maxStepsPerFrame;
+        pipeline->sim.boundary = walls;
+        pipeline->Start();
+    }
+    if (argc > 1 && !LoadEnvironment(sim, argc - 1, argv + 1))
+        TraceLog(LOG_WARNING, "Environment: expected one panorama or six cubemap faces");
 
     Image img = GenImageColor(simWidth, simHeight, BLACK);
     Texture2D tex = LoadTextureFromImage(img);
+    std::vector<Color> uploadStaging;
+
+    // "U" switches between shading at window resolution (the sim grid is
+    // upsampled per pixel) and stretching the sim-resolution image.
+    bool upsample = true;
+    Image screenImg = {};
+    Texture2D screenTex = {};
 
     Vector2 lightDir = { -0.4f, -0.6f };
     float len = std::sqrt(lightDir.x*lightDir.x + lightDir.y*lightDir.y + 1.0f);
@@ -161,10 +201,46 @@ int main() {
     unsigned char statusAlpha = 0;
     unsigned char targetAlpha = 0;
     Vector2 lastMouse = GetMousePosition();
+    std::vector<PointerStroke> pointers;
+    std::vector<PointerStroke> contacts;
 
     bool wasFullscreen = false;
 
+    // --- PROFILER ---
+    // "P" toggles the overlay, "C" dumps the recorded frames to CSV, "R"
+    // cycles the environment roughness (mip level), "L" toggles LUT
+    // shading.
+    FrameProfiler profiler;
+    bool showProfiler = false;
+    int csvDumps = 0;
+
     while (!WindowShouldClose()) {
+        profiler.BeginFrame();
+        FrameProfiler::Scope inputScope(profiler, ProfileStage::Input);
+
+        if (IsKeyPressed(KEY_P))
+            showProfiler = !showProfiler;
+        if (IsKeyPressed(KEY_U)) {
+            upsample = !upsample;
+            sim.InvalidateShading();
+        }
+        if (IsKeyPressed(KEY_R)) {
+            sim.environmentLod += 1.0f;
+            if (sim.environmentLod >= sim.environment.levels)
+                sim.environmentLod = 0.0f;
+            sim.InvalidateShading();
+        }
+        if (IsKeyPressed(KEY_L)) {
+            sim.lutShade = !sim.lutShade;
+            sim.InvalidateShading();
+        }
+        if (IsKeyPressed(KEY_C)) {
+            const char *path = TextFormat("mLiquidMetal_profile_%d.csv", csvDumps++);
+            if (profiler.WriteCsv(path))
+                TraceLog(LOG_INFO, "Profiler: wrote %s", path);
+            else
+                TraceLog(LOG_WARNING, "Profiler: could not write %s", path);
+        }
 
         // --- FULLSCREEN TOGGLE ---
         if (IsKeyPressed(KEY_F)) {
@@ -201,26 +277,101 @@ int main() {
         int drawW = GetRenderWidth();
         int drawH = GetRenderHeight();
 
-        // --- MOUSE INTERACTION ---
-        if (IsMouseButtonDown(MOUSE_LEFT_BUTTON)) {
-            float sx = curMouse.x * (float)simWidth / (float)drawW;
-            float sy = curMouse.y * (float)simHeight / (float)drawH;
-
-            int ix = (int)sx;
-            int iy = (int)sy;
+        // --- FIXED TIMESTEP ---
+        simAccumulator += GetFrameTime();
+        int steps = (int)(simAccumulator * simRate);
+        if (steps > maxStepsPerFrame) {
+            steps = maxStepsPerFrame;
+            simAccumulator = 0.0f;
+        } else {
+            simAccumulator -= steps / simRate;
+        }
+        inputScope.End();
+
+        // --- POINTER INTERACTION ---
+        // Every touch contact (or the mouse, when nothing touches the
+        // screen) lays down its movement since the last simulated frame as
+        // one continuous stroke. The strokes are only queued here; the next
+        // step applies all of them in a single batch. Their strength is
+        // scaled by the simulated time this frame, so it does not depend on
+        // the frame rate.
+        FrameProfiler::Scope impulseScope(profiler, ProfileStage::Impulse);
+        Vector2 toCells = { (float)simWidth / (float)drawW, (float)simHeight / (float)drawH };
+        contacts.clear();
+        int touchCount = GetTouchPointCount();
+        for (int i = 0; i < touchCount; ++i)
+            contacts.push_back({ GetTouchPointId(i), Vector2Multiply(GetTouchPosition(i), toCells) });
+        if (touchCount == 0 && IsMouseButtonDown(MOUSE_LEFT_BUTTON))
+            contacts.push_back({ kMousePointer, Vector2Multiply(curMouse, toCells) });
+
+        if (steps > 0) {
+            float amount = -1.5f * steps / substepsPerFrame;
+            for (const PointerStroke &c : contacts) {
+                Vector2 from = c.last;
+                for (const PointerStroke &p : pointers) {
+                    if (p.id == c.id)
+                        from = p.last;
+                }
 
-            if (ix > 1 && ix < simWidth - 1 && iy > 1 && iy < simHeight - 1) {
-                sim.AddImpulse(ix, iy, -1.5f);
+                if (pipeline)
+                    pipeline->AddStroke(from.x, from.y, c.last.x, c.last.y, amount);
+                else
+                    sim.QueueStroke(from.x, from.y, c.last.x, c.last.y, amount);
             }
+            // Pointers that are no longer down are dropped, so a new
+            // contact reusing the id starts a fresh stroke.
+            pointers = contacts;
+        } else {
+            // No step this frame: keep the strokes of pointers still down
+            // open so their next segment starts where the last one ended.
+            pointers.erase(std::remove_if(pointers.begin(), pointers.end(),
+                                          [&](const PointerStroke &p) {
+                                              for (const PointerStroke &c : contacts) {
+                                                  if (c.id == p.id)
+                                                      return false;
+                                              }
+                                              return true;
+                                          }),
+                           pointers.end());
         }
 
-        sim.Step();
+        impulseScope.End();
 
-        ImageClearBackground(&img, BLACK);
+        // Pipelined, the step stage only picks up the newest snapshot.
+        FrameProfiler::Scope stepScope(profiler, ProfileStage::Step);
+        if (pipeline)
+            pipeline->Acquire(sim);
+        else
+            sim.Advance(steps);
+        stepScope.End();
+
+        // Show the state between the last two steps that matches the
+        // leftover accumulator time.
+        sim.renderAlpha = pipeline ? 1.0f : simAccumulator * simRate;
+
+        FrameProfiler::Scope renderScope(profiler, ProfileStage::Render);
+        bool atScreen = upsample && drawW > 0 && drawH > 0;
+        if (atScreen && (screenImg.width != drawW || screenImg.height != drawH)) {
+            if (screenImg.data) {
+                UnloadTexture(screenTex);
+                UnloadImage(screenImg);
+            }
+            screenImg = GenImageColor(drawW, drawH, BLACK);
+            screenTex = LoadTextureFromImage(screenImg);
+        }
+        Image &target = atScreen ? screenImg : img;
+        RGBA8Span pixels = { (Rgba8 *)target.data, target.width, target.height, target.width };
+        if (atScreen)
+            sim.RenderUpsampled(pixels, lightDir.x, lightDir.y);
+        else
+            sim.RenderToImage(pixels, lightDir.x, lightDir.y);
+        renderScope.End();
 
-        sim.RenderToImage(img, lightDir);
-        UpdateTexture(tex, img.data);
+        FrameProfiler::Scope uploadScope(profiler, ProfileStage::Upload);
+        UploadDirtyRects(atScreen ? screenTex : tex, target, sim.dirtyRects, uploadStaging);
+        uploadScope.End();
 
+        FrameProfiler::Scope drawScope(profiler, ProfileStage::Draw);
         BeginDrawing();
         ClearBackground(rayBlue);
 
@@ -228,7 +379,10 @@ int main() {
         Rectangle dst = { 0, 0, (float)drawW, (float)drawH };
 
         BeginBlendMode(BLEND_ALPHA);
-        DrawTexturePro(tex, src, dst, {0,0}, 0.0f, WHITE);
+        if (atScreen)
+            DrawTexture(screenTex, 0, 0, WHITE);
+        else
+            DrawTexturePro(tex, src, dst, {0,0}, 0.0f, WHITE);
         EndBlendMode();
 
         if (statusAlpha > 0) {
@@ -239,13 +393,22 @@ int main() {
             DrawRectangle(0, drawH - 24, drawW, 24, bar);
             DrawLine(0, drawH - 24, drawW, drawH - 24, line);
 
-            DrawText("Click and drag your mouse. \"F\" toggles fullscreen.",
+            DrawText("Click and drag your mouse. \"F\" toggles fullscreen, \"P\" the profiler.",
                      8, drawH - 20, 16, text);
         }
 
+        if (showProfiler)
+            DrawProfilerOverlay(profiler, 8, 8);
+        drawScope.End();
+
+        FrameProfiler::Scope presentScope(profiler, ProfileStage::Present);
         EndDrawing();
     }
 
+    if (screenImg.data) {
+        UnloadTexture(screenTex);
+        UnloadImage(screenImg);
+    }
     UnloadTexture(tex);
     UnloadImage(img);
     CloseWindow();
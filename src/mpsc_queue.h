@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Bounded lock-free multi-producer, single-consumer queue.
+//
+// Every slot carries a sequence number that says whether it is free for
+// the producer at a given position or holds a value for the consumer at
+// it. A producer claims a position with one CAS on the tail and publishes
+// the slot with a release store, so producers only ever contend on that
+// CAS, and TryPush() never waits: when the queue is full it fails. The
+// consumer needs no atomic read-modify-write at all.
+template <typename T>
+class MpscQueue {
+public:
+    // capacity is rounded up to a power of two.
+    explicit MpscQueue(size_t capacity) {
+        size_t n = 2;
+        while (n < capacity)
+            n *= 2;
+        mask = n - 1;
+        slots.reset(new Slot[n]);
+        for (size_t i = 0; i < n; ++i)
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    MpscQueue(const MpscQueue &) = delete;
+    MpscQueue &operator=(const MpscQueue &) = delete;
+
+    size_t Capacity() const { return mask + 1; }
+
+    // Any thread.
+    bool TryPush(const T &value) {
+        size_t pos = tail.load(std::memory_order_relaxed);
+        Slot *slot;
+        for (;;) {
+            slot = &slots[pos & mask];
+            size_t seq = slot->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false; // full
+            } else {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+        slot->value = value;
+        slot->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer thread only.
+    bool TryPop(T &value) {
+        Slot &slot = slots[head & mask];
+        size_t seq = slot.sequence.load(std::memory_order_acquire);
+        if ((intptr_t)seq - (intptr_t)(head + 1) < 0)
+            return false; // empty, or the producer has not finished writing
+        value = slot.value;
+        slot.sequence.store(head + mask + 1, std::memory_order_release);
+        ++head;
+        return true;
+    }
+
+private:
+    struct Slot {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Slot[]> slots;
+    size_t mask = 0;
+    alignas(64) std::atomic<size_t> tail{ 0 };
+    alignas(64) size_t head = 0;
+};
@@ -0,0 +1,23 @@
+#pragma once
+
+// 8-bit RGBA pixel, same memory layout as raylib's Color.
+struct Rgba8 {
+    unsigned char r, g, b, a;
+};
+
+// Destination for RenderToImage(): width x height pixels of RGBA8, rows
+// pitch pixels apart.
+struct RGBA8Span {
+    Rgba8 *pixels;
+    int width;
+    int height;
+    int pitch;
+};
+
+// Read-only source image, same layout as RGBA8Span.
+struct RGBA8View {
+    const Rgba8 *pixels;
+    int width;
+    int height;
+    int pitch;
+};
@@ -0,0 +1,432 @@
+// The SIMD kernels, compiled once per variant (see sim_kernels.h).
+// CMake defines MLM_KERNELS_TABLE (the exported table function) and
+// MLM_KERNELS_NAME and sets the instruction-set flags.
+//
+// Everything here is in the anonymous namespace or is a simd.h wrapper,
+// which lives in a per-level namespace. Only constants are taken from
+// liquid_sim.h, and no standard library templates or inline functions are
+// used: a copy of one built with AVX flags could otherwise be picked by
+// the linker for baseline callers.
+
+#include "sim_kernels.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "liquid_sim.h"
+#include "simd.h"
+
+#if !defined(MLM_KERNELS_TABLE) || !defined(MLM_KERNELS_NAME)
+#error "sim_kernels.cpp is built per variant by CMake"
+#endif
+
+namespace {
+
+using namespace simd;
+
+inline int MinInt(int a, int b) { return a < b ? a : b; }
+inline int MaxInt(int a, int b) { return a > b ? a : b; }
+
+// One row of the fused integrator: reads heights from the previous
+// buffer (rows hN, hC, hS), updates velocity in place and writes the new
+// heights to out. Per cell this is exactly the two-pass sequence
+//   v = (v + (sum - 4c) * k) * 0.94;  h' = c + v
+// so both modes produce identical fields.
+inline void FusedRow(const float *hN, const float *hC, const float *hS,
+                     float *v, float *out, int x0, int x1, float k) {
+    const FV kk = Broadcast(k);
+    const FV four = Broadcast(4.0f);
+    const FV damp = Broadcast(0.94f);
+    int x = x0;
+    for (; x + kLanes <= x1; x += kLanes) {
+        FV c = Load(hC + x);
+        FV sum = Load(hC + x - 1) + Load(hC + x + 1) + Load(hN + x) + Load(hS + x);
+        FV vel = (Load(v + x) + (sum - four * c) * kk) * damp;
+        Store(v + x, vel);
+        Store(out + x, c + vel);
+    }
+    for (; x < x1; ++x) {
+        float sum = hC[x - 1] + hC[x + 1] + hN[x] + hS[x];
+        float vel = (v[x] + (sum - 4.0f * hC[x]) * k) * 0.94f;
+        v[x] = vel;
+        out[x] = hC[x] + vel;
+    }
+}
+
+void FusedRowsGeneric(const float *h, float *v, float *out, int pitch, int y0, int y1, float k) {
+    for (int y = y0; y < y1; ++y) {
+        size_t row = (size_t)y * pitch;
+        FusedRow(h + row - pitch, h + row, h + row + pitch, v + row, out + row, 0, pitch, k);
+    }
+}
+
+// Fused rows with the width fixed at compile time: the same row kernel,
+// with constant bounds and row stride.
+template <int W>
+void FusedRowsFixed(const float *h, float *v, float *out, int, int y0, int y1, float k) {
+    constexpr int P = LiquidSim::PitchFor(W);
+    for (int y = y0; y < y1; ++y) {
+        size_t row = (size_t)y * P;
+        FusedRow(h + row - P, h + row, h + row + P, v + row, out + row, 0, P, k);
+    }
+}
+
+// Two-pass step. Full rows; the ghost velocities the force pass writes
+// are reset after the integrate pass.
+void ForceRows(const float *h, float *v, int pitch, int y0, int y1, float k) {
+    const FV kk = Broadcast(k);
+    const FV four = Broadcast(4.0f);
+    for (int y = y0; y < y1; ++y) {
+        const float *hN = h + (size_t)(y - 1) * pitch;
+        const float *hC = hN + pitch;
+        const float *hS = hC + pitch;
+        float *vr = v + (size_t)y * pitch;
+        for (int x = 0; x < pitch; x += kLanes) {
+            FV sum = Load(hC + x - 1) + Load(hC + x + 1) + Load(hN + x) + Load(hS + x);
+            FV force = (sum - four * Load(hC + x)) * kk;
+            Store(vr + x, Load(vr + x) + force);
+        }
+    }
+}
+
+void IntegrateRows(float *h, float *v, int pitch, int y0, int y1) {
+    const FV damp = Broadcast(0.94f);
+    for (int y = y0; y < y1; ++y) {
+        float *hr = h + (size_t)y * pitch;
+        float *vr = v + (size_t)y * pitch;
+        for (int x = 0; x < pitch; x += kLanes) {
+            FV vel = Load(vr + x) * damp;
+            Store(vr + x, vel);
+            Store(hr + x, Load(hr + x) + vel);
+        }
+    }
+}
+
+void Sponge(float *h, float *v, const float *column, float rowScale, int x0, int x1) {
+    const FV rs = Broadcast(rowScale);
+    int x = x0;
+    for (; x + kLanes <= x1; x += kLanes) {
+        FV m = Min(Load(column + x), rs);
+        Store(h + x, Load(h + x) * m);
+        Store(v + x, Load(v + x) * m);
+    }
+    for (; x < x1; ++x) {
+        float m = column[x] < rowScale ? column[x] : rowScale;
+        h[x] *= m;
+        v[x] *= m;
+    }
+}
+
+// Packed fused rows: the same integrator on 16-bit planes, widened to
+// 32-bit lanes on load and narrowed on store. Rows are full, as above.
+
+// Half storage: the fp32 kernel between conversions.
+void FusedRowsHalf(const uint16_t *h, uint16_t *v, uint16_t *out, int pitch, int y0, int y1, float k) {
+    const FV kk = Broadcast(k);
+    const FV four = Broadcast(4.0f);
+    const FV damp = Broadcast(0.94f);
+    for (int y = y0; y < y1; ++y) {
+        size_t row = (size_t)y * pitch;
+        const uint16_t *hN = h + row - pitch;
+        const uint16_t *hC = h + row;
+        const uint16_t *hS = h + row + pitch;
+        uint16_t *vr = v + row;
+        uint16_t *o = out + row;
+        for (int x = 0; x < pitch; x += kLanes) {
+            FV c = LoadHalf(hC + x);
+            FV sum = LoadHalf(hC + x - 1) + LoadHalf(hC + x + 1) + LoadHalf(hN + x) + LoadHalf(hS + x);
+            FV vel = (LoadHalf(vr + x) + (sum - four * c) * kk) * damp;
+            StoreHalf(vr + x, vel);
+            StoreHalf(o + x, c + vel);
+        }
+    }
+}
+
+// Fixed16 storage in int32 lanes, velocities in units a quarter of the
+// height unit (LiquidSim::fixedVelocityExtraBits). The stencil is exact;
+// k and the 0.94 damping are Q14. The force and the height update round
+// to nearest and the damped velocity toward zero, so small velocities
+// always shrink. Only the ratio of the two scales enters, so the kernel
+// does not depend on fixedFractionBits. |sum| < 2^18 and k <= 0.5 keep
+// sum * k inside int32, so larger k is clamped to 0.5 (the fp32 solver's
+// stability limit; LiquidSim::SetStorage() rejects it up front).
+// Velocities saturate to the int16 range, the bounds StoreInt16 packs to.
+void FusedRowsFixed16(const uint16_t *h, uint16_t *v, uint16_t *out, int pitch, int y0, int y1, float k) {
+    static_assert(LiquidSim::fixedVelocityExtraBits == 2, "the shifts below assume 2 extra bits");
+    const IV kq = BroadcastInt(MinInt(MaxInt((int)lroundf(k * 16384.0f), 0), 8192));
+    const IV dq = BroadcastInt(15401); // 0.94 * 2^14
+    const IV forceHalf = BroadcastInt(1 << 11);
+    const IV towardZero = BroadcastInt((1 << 14) - 1);
+    const IV stepHalf = BroadcastInt(2);
+    const IV lo = BroadcastInt(INT16_MIN);
+    const IV hi = BroadcastInt(INT16_MAX);
+    for (int y = y0; y < y1; ++y) {
+        size_t row = (size_t)y * pitch;
+        const int16_t *hN = (const int16_t *)h + row - pitch;
+        const int16_t *hC = (const int16_t *)h + row;
+        const int16_t *hS = (const int16_t *)h + row + pitch;
+        int16_t *vr = (int16_t *)v + row;
+        int16_t *o = (int16_t *)out + row;
+        for (int x = 0; x < pitch; x += kLanes) {
+            IV c = LoadInt16(hC + x);
+            IV sum = (LoadInt16(hC + x - 1) + LoadInt16(hC + x + 1)) +
+                     (LoadInt16(hN + x) + LoadInt16(hS + x)) - ShiftLeft<2>(c);
+            IV force = ShiftRight<12>(sum * kq + forceHalf);
+            IV vel = Min(Max(LoadInt16(vr + x) + force, lo), hi);
+            IV p = vel * dq;
+            vel = ShiftRight<14>(p + (ShiftRight<31>(p) & towardZero));
+            StoreInt16(vr + x, vel);
+            // vel / 4 rounded to nearest, ties away from zero.
+            StoreInt16(o + x, c + ShiftRight<2>(vel + stepHalf + ShiftRight<31>(vel)));
+        }
+    }
+}
+
+void DecodeHalf(const uint16_t *in, float *out, size_t n) {
+    size_t i = 0;
+    for (; i + kLanes <= n; i += kLanes)
+        Store(out + i, LoadHalf(in + i));
+    for (; i < n; ++i)
+        out[i] = HalfToFloat(in[i]);
+}
+
+void EncodeHalf(const float *in, uint16_t *out, size_t n) {
+    size_t i = 0;
+    for (; i + kLanes <= n; i += kLanes)
+        StoreHalf(out + i, Load(in + i));
+    for (; i < n; ++i)
+        out[i] = FloatToHalf(in[i]);
+}
+
+void DecodeFixed16(const int16_t *in, float *out, size_t n, float scale) {
+    const FV s = Broadcast(scale);
+    size_t i = 0;
+    for (; i + kLanes <= n; i += kLanes)
+        Store(out + i, ToFloat(LoadInt16(in + i)) * s);
+    for (; i < n; ++i)
+        out[i] = in[i] * scale;
+}
+
+// Rounds to nearest and saturates to the int16 range.
+void EncodeFixed16(const float *in, int16_t *out, size_t n, float scale) {
+    const float low = INT16_MIN;
+    const float high = INT16_MAX;
+    const FV s = Broadcast(scale);
+    const FV lo = Broadcast(low);
+    const FV hi = Broadcast(high);
+    size_t i = 0;
+    for (; i + kLanes <= n; i += kLanes)
+        StoreInt16(out + i, RoundToInt(Min(Max(Load(in + i) * s, lo), hi)));
+    for (; i < n; ++i) {
+        float q = in[i] * scale;
+        q = q < low ? low : q > high ? high : q;
+        out[i] = (int16_t)lrintf(q);
+    }
+}
+
+void AddScaledRow(float *row, const float *w, float a, int n) {
+    const FV aa = Broadcast(a);
+    int i = 0;
+    for (; i + kLanes <= n; i += kLanes)
+        Store(row + i, Load(row + i) + aa * Load(w + i));
+    for (; i < n; ++i)
+        row[i] += a * w[i];
+}
+
+// SIMD version of LiquidSim::ShadeGradient(): normalized normal, ndotl,
+// chrome curve via the table, branchless dominant-axis face selection over
+// a flat environment, and RGBA8 packing through a clamped float-to-int
+// conversion. Packing assumes a little-endian target (R in the low byte).
+struct ExactShader {
+    const float *chromeTable;
+    FV zero = Broadcast(0.0f);
+    FV one = Broadcast(1.0f);
+    FV lx, ly;
+    FV base = Broadcast(0.4f);
+    FV scale = Broadcast(0.6f);
+    FV chromeWeight = Broadcast(0.4f);
+    FV envWeight = Broadcast(0.6f);
+    FV steps;
+    FV half = Broadcast(0.5f);
+    FV maxByte = Broadcast(255.0f);
+    IV alpha = BroadcastInt(180 << 24);
+    FV faces[6][3];
+
+    explicit ExactShader(const ShadeParams &p)
+        : chromeTable(p.chromeTable), lx(Broadcast(p.lightX)), ly(Broadcast(p.lightY)),
+          steps(Broadcast((float)p.chromeSteps)) {
+        for (int f = 0; f < 6; ++f) {
+            faces[f][0] = Broadcast(p.faces[f].r);
+            faces[f][1] = Broadcast(p.faces[f].g);
+            faces[f][2] = Broadcast(p.faces[f].b);
+        }
+    }
+
+    IV operator()(FV dx, FV dy) const {
+        FV len = Sqrt(dx * dx + dy * dy + one);
+        FV nx = (zero - dx) / len;
+        FV ny = (zero - dy) / len;
+        FV nz = one / len;
+
+        FV ndotl = nx * lx + ny * ly + nz * one;
+        FV intensity = Min(Max(base + ndotl * scale, zero), one);
+        FV chrome = Gather(chromeTable, TruncateToInt(intensity * steps + half));
+
+        FV ax = Abs(nx);
+        FV ay = Abs(ny);
+        FV az = Abs(nz);
+        MV xMajor = (ax > ay) & (ax > az);
+        MV yMajor = AndNot(xMajor, ay > az);
+        MV xPos = nx > zero;
+        MV yPos = ny > zero;
+        MV zPos = nz > zero;
+
+        IV packed = alpha;
+        for (int c = 0; c < 3; ++c) {
+            FV env = Select(xMajor, Select(xPos, faces[0][c], faces[1][c]),
+                     Select(yMajor, Select(yPos, faces[2][c], faces[3][c]),
+                                    Select(zPos, faces[4][c], faces[5][c])));
+            FV v = Min(Max(chrome * chromeWeight + env * envWeight, zero), maxByte);
+            IV byte = TruncateToInt(v);
+            if (c == 1)
+                byte = ShiftLeft<8>(byte);
+            else if (c == 2)
+                byte = ShiftLeft<16>(byte);
+            packed = packed | byte;
+        }
+        return packed;
+    }
+};
+
+// LUT shading: quantize (dx, dy) to table indices and gather the finished
+// pixels. Rows are lutSize entries apart, as in LiquidSim::ShadeLut().
+struct LutShader {
+    const uint32_t *table;
+    FV offset, scale;
+    FV zero = Broadcast(0.0f);
+    FV last;
+    IV stride;
+
+    explicit LutShader(const ShadeParams &p)
+        : table((const uint32_t *)p.lut), offset(Broadcast(p.lutRange)),
+          scale(Broadcast(p.lutSize / (2.0f * p.lutRange))),
+          last(Broadcast((float)(p.lutSize - 1))), stride(BroadcastInt(p.lutSize)) {}
+
+    IV operator()(FV dx, FV dy) const {
+        IV ix = TruncateToInt(Min(Max((dx + offset) * scale, zero), last));
+        IV iy = TruncateToInt(Min(Max((dy + offset) * scale, zero), last));
+        return Gather(table, iy * stride + ix);
+    }
+};
+
+template <typename Shader>
+int ShadeRowsWith(const Shader &shade, const float *field, int pitch, Rgba8 *pixels, int imgPitch,
+                  int x0, int y0, int x1, int y1) {
+    int end = x0;
+    for (int y = y0; y < y1; ++y) {
+        Rgba8 *out = pixels + (size_t)y * imgPitch;
+        const float *hN = field + (size_t)(y - 1) * pitch;
+        const float *hC = hN + pitch;
+        const float *hS = hC + pitch;
+        int x = x0;
+        for (; x + kLanes <= x1; x += kLanes) {
+            FV dx = Load(hC + x + 1) - Load(hC + x - 1);
+            FV dy = Load(hS + x) - Load(hN + x);
+            Store((uint32_t *)(out + x), shade(dx, dy));
+        }
+        // Wider vectors finish the last whole groups from copies, so the
+        // columns left to the caller match the shadeGroup-wide variants.
+        const int groups = (x1 - x) / SimKernels::shadeGroup * SimKernels::shadeGroup;
+        if (kLanes > SimKernels::shadeGroup && groups > 0) {
+            float gx[kLanes] = {};
+            float gy[kLanes] = {};
+            for (int i = 0; i < groups; ++i) {
+                gx[i] = hC[x + i + 1] - hC[x + i - 1];
+                gy[i] = hS[x + i] - hN[x + i];
+            }
+            uint32_t shaded[kLanes];
+            Store(shaded, shade(Load(gx), Load(gy)));
+            memcpy(out + x, shaded, groups * sizeof(uint32_t));
+            x += groups;
+        }
+        end = x;
+    }
+    return end;
+}
+
+int ShadeRows(const ShadeParams &p, const float *field, int pitch, Rgba8 *pixels, int imgPitch,
+              int x0, int y0, int x1, int y1) {
+    if (p.lut)
+        return ShadeRowsWith(LutShader(p), field, pitch, pixels, imgPitch, x0, y0, x1, y1);
+    return ShadeRowsWith(ExactShader(p), field, pitch, pixels, imgPitch, x0, y0, x1, y1);
+}
+
+// Horizontal pass of RenderUpsampled() for one gradient row: output
+// pixels [x0, x1) (rounded up to whole vectors) get the row's value at
+// their sample position, from the left sim column and weight per pixel.
+void WidenRow(const float *g, const int *column, const float *weight, float *out, int x0, int x1) {
+    for (int x = x0; x < x1; x += kLanes) {
+        IV i = LoadInt(column + x);
+        FV a = Gather(g, i);
+        Store(out + x, a + (Gather(g + 1, i) - a) * Load(weight + x));
+    }
+}
+
+// Vertical pass plus shading: blends two widened rows by fy and shades
+// output pixels [x0, x1). The last vector is stored partially.
+template <typename Shader>
+void UpsampleRowWith(const Shader &shade, const float *ax, const float *ay, const float *bx,
+                     const float *by, float fy, Rgba8 *out, int x0, int x1) {
+    const FV w = Broadcast(fy);
+    for (int x = x0; x < x1; x += kLanes) {
+        FV gx = Load(ax + x);
+        FV gy = Load(ay + x);
+        IV pixels = shade(gx + (Load(bx + x) - gx) * w, gy + (Load(by + x) - gy) * w);
+        if (x + kLanes <= x1) {
+            Store((uint32_t *)(out + x), pixels);
+        } else {
+            uint32_t tail[kLanes];
+            Store(tail, pixels);
+            memcpy(out + x, tail, (x1 - x) * sizeof(uint32_t));
+        }
+    }
+}
+
+void UpsampleRow(const ShadeParams &p, const float *ax, const float *ay, const float *bx,
+                 const float *by, float fy, Rgba8 *out, int x0, int x1) {
+    if (p.lut)
+        UpsampleRowWith(LutShader(p), ax, ay, bx, by, fy, out, x0, x1);
+    else
+        UpsampleRowWith(ExactShader(p), ax, ay, bx, by, fy, out, x0, x1);
+}
+
+} // namespace
+
+const SimKernels &MLM_KERNELS_TABLE() {
+    static_assert(kLanes <= SimKernels::maxWidth && kLanes % SimKernels::shadeGroup == 0,
+                  "vector width must fit the padding and the shading groups");
+    static_assert(LiquidSim::PitchFor(1) % kLanes == 0, "full-row kernels need whole vectors per row");
+    static const SimKernels table = {
+        MLM_KERNELS_NAME,
+        kLanes,
+        FusedRowsGeneric,
+        { FusedRowsFixed<LiquidSim::fixedKernelWidths[0]>, FusedRowsFixed<LiquidSim::fixedKernelWidths[1]>,
+          FusedRowsFixed<LiquidSim::fixedKernelWidths[2]>, FusedRowsFixed<LiquidSim::fixedKernelWidths[3]> },
+        FusedRow,
+        ForceRows,
+        IntegrateRows,
+        Sponge,
+        FusedRowsHalf,
+        FusedRowsFixed16,
+        DecodeHalf,
+        EncodeHalf,
+        DecodeFixed16,
+        EncodeFixed16,
+        AddScaledRow,
+        ShadeRows,
+        WidenRow,
+        UpsampleRow,
+    };
+    return table;
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "rgba8.h"
+
+// Table of the SIMD kernels behind Step(), RenderToImage(),
+// RenderUpsampled() and AddImpulse(): 8 lanes, 16 in the avx512 variant.
+//
+// sim_kernels.cpp is compiled once per variant in
+// MLIQUIDMETAL_KERNEL_VARIANTS (scalar, sse4.2, avx2, avx512), each with
+// its own instruction-set flags, and every build exports one table. The
+// rest of the library is built for the baseline target and calls through
+// ActiveKernels(), which picks the best variant the CPU supports on first
+// use. Setting MLIQUIDMETAL_KERNELS in the environment to a variant name
+// forces that variant instead; a name that was not built or that the CPU
+// cannot run is reported on stderr and ignored.
+//
+// All variants run the same arithmetic in the same order and without FMA
+// contraction, so they produce identical fields and images.
+
+// Shading inputs shared by the row shaders: the light, the chrome curve
+// table (chromeSteps + 1 entries over [0, 1]) and either the flat
+// environment (one colour per cubemap face) or, when lut is set, the
+// shading LUT.
+struct ShadeParams {
+    float lightX, lightY;
+    const float *chromeTable;
+    int chromeSteps;
+    const Rgba8 *faces;
+    const Rgba8 *lut;
+    int lutSize;
+    float lutRange;
+};
+
+struct SimKernels {
+    // Widest vector of any variant. Buffers the kernels sweep in whole
+    // vectors past the end of a span are padded by this many entries.
+    static constexpr int maxWidth = 16;
+    // Pixels shadeRows() covers come in groups of this many, whatever the
+    // vector width, so every variant leaves the caller the same remainder.
+    static constexpr int shadeGroup = 8;
+
+    typedef void (*FusedRowsFn)(const float *h, float *v, float *out, int pitch,
+                                int y0, int y1, float k);
+    typedef void (*PackedRowsFn)(const uint16_t *h, uint16_t *v, uint16_t *out, int pitch,
+                                 int y0, int y1, float k);
+
+    const char *name;
+    int width;  // cells per vector
+
+    // --- Step ---
+    // Fused step over full rows (LiquidSim::FusedRowsFn): any width, and
+    // one per LiquidSim::fixedKernelWidths entry.
+    FusedRowsFn fusedRows;
+    FusedRowsFn fusedRowsFixed[4];
+    // Fused step of cells [x0, x1) of one row, for sparse tiles.
+    void (*fusedRow)(const float *hN, const float *hC, const float *hS,
+                     float *v, float *out, int x0, int x1, float k);
+    // The two passes of the two-pass step over full rows [y0, y1).
+    void (*forceRows)(const float *h, float *v, int pitch, int y0, int y1, float k);
+    void (*integrateRows)(float *h, float *v, int pitch, int y0, int y1);
+    // Scales h and v in [x0, x1) by min(column[x], rowScale).
+    void (*sponge)(float *h, float *v, const float *column, float rowScale, int x0, int x1);
+    // Fused step on 16-bit planes (LiquidSim::Storage).
+    PackedRowsFn fusedRowsHalf;
+    PackedRowsFn fusedRowsFixed16;
+    // Storage conversions of n values; fixed point is q * scale in fp32.
+    void (*decodeHalf)(const uint16_t *in, float *out, size_t n);
+    void (*encodeHalf)(const float *in, uint16_t *out, size_t n);
+    void (*decodeFixed16)(const int16_t *in, float *out, size_t n, float scale);
+    void (*encodeFixed16)(const float *in, int16_t *out, size_t n, float scale);
+
+    // --- Input ---
+    // row[i] += a * w[i] for i in [0, n).
+    void (*addScaledRow)(float *row, const float *w, float a, int n);
+
+    // --- Shading ---
+    // Shades cells [x0, x1) of rows [y0, y1) of field (pixel (x, y) into
+    // pixels[y * imgPitch + x]) in whole groups of shadeGroup pixels and
+    // returns the column where every row stopped; the caller shades the
+    // rest.
+    int (*shadeRows)(const ShadeParams &p, const float *field, int pitch, Rgba8 *pixels,
+                     int imgPitch, int x0, int y0, int x1, int y1);
+    // RenderUpsampled() passes: see WidenRow() and UpsampleRowWith() in
+    // sim_kernels.cpp.
+    void (*widenRow)(const float *g, const int *column, const float *weight, float *out,
+                     int x0, int x1);
+    void (*upsampleRow)(const ShadeParams &p, const float *ax, const float *ay,
+                        const float *bx, const float *by, float fy, Rgba8 *out, int x0, int x1);
+};
+
+// One table per built variant; only call those the CPU supports.
+const SimKernels &SimKernelsScalar();
+const SimKernels &SimKernelsSse42();
+const SimKernels &SimKernelsAvx2();
+const SimKernels &SimKernelsAvx512();
+
+// The variant in use, selected on the first call.
+const SimKernels &ActiveKernels();
+
+// Names of the variants built into this binary, best last, and whether
+// the running CPU supports each.
+int KernelVariantCount();
+const char *KernelVariantName(int i);
+bool KernelVariantSupported(int i);
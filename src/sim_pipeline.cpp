@@ -0,0 +1,119 @@
+#include "sim_pipeline.h"
+
+#include <algorithm>
+#include <chrono>
+
+SimPipeline::SimPipeline(int w, int h, float stepsPerSecond, int threads)
+    : sim(w, h, threads), stepsPerSecond(stepsPerSecond) {
+    tileVersion.assign(sim.tilesX * sim.tilesY, 0);
+}
+
+SimPipeline::~SimPipeline() {
+    Stop();
+}
+
+void SimPipeline::Start() {
+    if (thread.joinable())
+        return;
+    quit.store(false);
+    thread = std::thread([this] { Run(); });
+}
+
+void SimPipeline::Stop() {
+    quit.store(true);
+    if (thread.joinable())
+        thread.join();
+}
+
+bool SimPipeline::Acquire(LiquidSim &view) {
+    // Checked before taking the slot, so a mismatched view does not
+    // consume a snapshot. The dimensions never change after construction.
+    if (view.width != sim.width || view.height != sim.height || view.pitch != sim.pitch ||
+        view.tileDirty.size() != tileVersion.size())
+        return false;
+    if (!snapshots.Acquire())
+        return false;
+    Snapshot &s = snapshots.Front();
+
+    for (size_t t = 0; t < s.tileVersion.size(); ++t) {
+        if (s.tileVersion[t] > acquiredSequence)
+            view.tileDirty[t] = 1;
+    }
+
+    // The slot keeps the view's old heights, which are those of the
+    // previously acquired snapshot; Publish() only refreshes the tiles
+    // that changed since.
+    std::swap(view.heightField, s.heights);
+    std::swap(acquiredSequence, s.sequence);
+    return true;
+}
+
+void SimPipeline::Run() {
+    typedef std::chrono::steady_clock Clock;
+    const Clock::duration stepTime = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(1.0 / stepsPerSecond));
+
+    Publish();
+    Clock::time_point next = Clock::now() + stepTime;
+    while (!quit.load(std::memory_order_relaxed)) {
+        Clock::time_point now = Clock::now();
+        if (now < next) {
+            std::this_thread::sleep_until(next);
+            continue;
+        }
+
+        int steps = 0;
+        while (next <= now && steps < maxCatchUpSteps) {
+            next += stepTime;
+            ++steps;
+        }
+        if (next <= now)
+            next = now + stepTime; // too far behind: drop the excess
+
+        sim.Advance(steps);
+        Publish();
+    }
+}
+
+void SimPipeline::Publish() {
+    // Nothing renders the sim itself, so its tileDirty collects every
+    // change since the last publication.
+    ++sequence;
+    for (size_t t = 0; t < tileVersion.size(); ++t) {
+        if (sim.tileDirty[t]) {
+            tileVersion[t] = sequence;
+            sim.tileDirty[t] = 0;
+        }
+    }
+
+    sim.SyncHeights();
+    Snapshot &s = snapshots.Back();
+    if (s.heights.size() != sim.heightField.size()) {
+        s.heights.assign(sim.heightField.begin(), sim.heightField.end());
+    } else {
+        // The slot holds the heights of step s.sequence: copy the tiles
+        // that changed after it, plus the ghost ring, whose copies of
+        // other tiles' cells carry no version of their own.
+        const float *from = sim.heightField.data();
+        float *to = s.heights.data();
+        for (int t = 0; t < (int)tileVersion.size(); ++t) {
+            if (tileVersion[t] <= s.sequence)
+                continue;
+            int x0, y0, x1, y1;
+            sim.TileBounds(t, x0, y0, x1, y1);
+            for (int y = y0; y < y1; ++y)
+                std::copy(from + sim.idx(x0, y), from + sim.idx(x1, y), to + sim.idx(x0, y));
+        }
+        const int w = sim.width;
+        const int h = sim.height;
+        std::copy(from, from + sim.idx(w, 0), to);
+        std::copy(from + sim.idx(0, h - 1), from + sim.idx(w, h - 1), to + sim.idx(0, h - 1));
+        for (int y = 1; y < h - 1; ++y) {
+            to[sim.idx(0, y)] = from[sim.idx(0, y)];
+            to[sim.idx(w - 1, y)] = from[sim.idx(w - 1, y)];
+        }
+    }
+    s.tileVersion = tileVersion;
+    s.sequence = sequence;
+    snapshots.Publish();
+}
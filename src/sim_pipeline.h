@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "liquid_sim.h"
+#include "triple_buffer.h"
+
+// Runs a LiquidSim on its own thread at a fixed step rate and hands every
+// finished batch of steps to the render thread as a height snapshot.
+//
+// Snapshots go through a triple buffer, so the sim thread never waits for
+// rendering and the render thread always picks up the newest complete
+// step; a frame costs max(step, render) instead of their sum. Strokes
+// travel the other way through the sim's posted-input queue and are
+// applied before the next step. Nothing on either hot path locks.
+//
+// Latency is bounded: an impulse is simulated within one step interval,
+// published as soon as that step ends, and shown by the next frame. A sim
+// thread that falls behind drops time (at most maxCatchUpSteps per batch)
+// rather than queueing work.
+struct SimPipeline {
+    // Slots are reused: Publish() copies only the tiles that changed since
+    // the step a slot's heights were taken at, so a batch that touches a
+    // few tiles costs a few tiles' worth of copying.
+    struct Snapshot {
+        LiquidSim::Field heights;
+        std::vector<uint64_t> tileVersion; // last sequence that changed each tile
+        uint64_t sequence = 0;             // step sequence heights holds
+    };
+
+    // Configure sim before Start(); afterwards it belongs to the sim thread
+    // (apart from PostStroke(), which any thread may call).
+    LiquidSim sim;
+    float stepsPerSecond;
+    int maxCatchUpSteps = 8;
+
+    SimPipeline(int w, int h, float stepsPerSecond, int threads = 0);
+    ~SimPipeline();
+
+    SimPipeline(const SimPipeline &) = delete;
+    SimPipeline &operator=(const SimPipeline &) = delete;
+
+    void Start();
+    void Stop();
+
+    // Any thread; see LiquidSim::PostStroke().
+    bool AddStroke(float x0, float y0, float x1, float y1, float amount, int radius = 3) {
+        return sim.PostStroke(x0, y0, x1, y1, amount, radius);
+    }
+    bool AddImpulse(int x, int y, float amount, int radius = 3) {
+        return sim.PostImpulse((float)x, (float)y, amount, radius);
+    }
+
+    // Render thread only. Moves the newest published snapshot into
+    // view.heightField and marks the tiles that changed since the
+    // previously acquired one dirty, so view.RenderToImage() or
+    // RenderUpsampled() re-shade only those. view must be the same size as
+    // sim, must not interpolate (keepPreviousHeights off) and must leave
+    // heightField as acquired. Returns false if nothing new was published,
+    // or if view's size does not match (without consuming the snapshot).
+    bool Acquire(LiquidSim &view);
+
+    // Sim thread.
+    void Run();
+    void Publish();
+
+    std::thread thread;
+    std::atomic<bool> quit{ false };
+    TripleBuffer<Snapshot> snapshots;
+    std::vector<uint64_t> tileVersion;
+    uint64_t sequence = 0;
+    uint64_t acquiredSequence = 0;
+};
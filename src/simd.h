@@ -0,0 +1,326 @@
+#pragma once
+
+// Minimal SIMD wrapper used by the wave and shading kernels.
+//
+// The instruction set is picked at compile time: AVX-512 (F, VL, BW, DQ)
+// when the compiler targets it, AVX2 (-mavx2, /arch:AVX2), two SSE
+// registers when SSE4.1 is available, and plain arrays otherwise so the
+// kernels still build on every platform raylib supports.
+//
+// FV holds kLanes floats, IV kLanes int32s and MV a per-lane mask from a
+// compare: 8 lanes everywhere except AVX-512, where they are one zmm (or
+// mask) register of 16. Kernels step by kLanes; full-row kernels rely on
+// the field pitch being a multiple of 16. Half-precision loads and stores
+// use F16C when the compiler targets it and the bit-exact conversions
+// from half.h otherwise.
+//
+// sim_kernels.cpp is compiled once per instruction set into the same
+// binary, so everything here lives in an inline namespace named after the
+// level: the builds get distinct symbols, and the linker can never hand
+// baseline code an AVX copy of an inline function that was not inlined.
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include "half.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define MLM_SIMD_AVX2 1
+#if defined(__AVX512F__) && defined(__AVX512VL__) && defined(__AVX512BW__) && defined(__AVX512DQ__)
+#define MLM_SIMD_AVX512 1
+#endif
+#elif defined(__SSE4_1__)
+#include <smmintrin.h>
+#define MLM_SIMD_SSE41 1
+#endif
+
+namespace simd {
+
+#if defined(MLM_SIMD_AVX512)
+inline namespace avx512 {
+#elif defined(MLM_SIMD_AVX2)
+inline namespace avx2 {
+#elif defined(MLM_SIMD_SSE41)
+inline namespace sse41 {
+#else
+inline namespace generic {
+#endif
+
+#if defined(MLM_SIMD_AVX512)
+constexpr int kLanes = 16;
+#else
+constexpr int kLanes = 8;
+#endif
+
+#if defined(MLM_SIMD_AVX512)
+
+struct FV { __m512 v; };
+struct IV { __m512i v; };
+struct MV { __mmask16 v; };
+
+inline FV Load(const float *p) { return { _mm512_loadu_ps(p) }; }
+inline void Store(float *p, FV a) { _mm512_storeu_ps(p, a.v); }
+inline FV Broadcast(float s) { return { _mm512_set1_ps(s) }; }
+
+inline FV operator+(FV a, FV b) { return { _mm512_add_ps(a.v, b.v) }; }
+inline FV operator-(FV a, FV b) { return { _mm512_sub_ps(a.v, b.v) }; }
+inline FV operator*(FV a, FV b) { return { _mm512_mul_ps(a.v, b.v) }; }
+inline FV operator/(FV a, FV b) { return { _mm512_div_ps(a.v, b.v) }; }
+inline FV Sqrt(FV a) { return { _mm512_sqrt_ps(a.v) }; }
+inline FV Min(FV a, FV b) { return { _mm512_min_ps(a.v, b.v) }; }
+inline FV Max(FV a, FV b) { return { _mm512_max_ps(a.v, b.v) }; }
+inline FV Abs(FV a) { return { _mm512_andnot_ps(_mm512_set1_ps(-0.0f), a.v) }; }
+
+inline MV operator>(FV a, FV b) { return { _mm512_cmp_ps_mask(a.v, b.v, _CMP_GT_OQ) }; }
+inline MV operator<(FV a, FV b) { return { _mm512_cmp_ps_mask(a.v, b.v, _CMP_LT_OQ) }; }
+inline MV operator&(MV a, MV b) { return { (__mmask16)(a.v & b.v) }; }
+inline MV AndNot(MV a, MV b) { return { (__mmask16)(~a.v & b.v) }; } // !a & b
+inline FV Select(MV m, FV a, FV b) { return { _mm512_mask_blend_ps(m.v, b.v, a.v) }; } // m ? a : b
+
+inline IV BroadcastInt(int32_t s) { return { _mm512_set1_epi32(s) }; }
+inline IV LoadInt(const int32_t *p) { return { _mm512_loadu_si512(p) }; }
+inline IV TruncateToInt(FV a) { return { _mm512_cvttps_epi32(a.v) }; }
+inline IV operator|(IV a, IV b) { return { _mm512_or_si512(a.v, b.v) }; }
+template <int N> inline IV ShiftLeft(IV a) { return { _mm512_slli_epi32(a.v, N) }; }
+inline void Store(uint32_t *p, IV a) { _mm512_storeu_si512(p, a.v); }
+inline IV operator+(IV a, IV b) { return { _mm512_add_epi32(a.v, b.v) }; }
+inline IV operator-(IV a, IV b) { return { _mm512_sub_epi32(a.v, b.v) }; }
+inline IV operator*(IV a, IV b) { return { _mm512_mullo_epi32(a.v, b.v) }; }
+inline IV operator&(IV a, IV b) { return { _mm512_and_si512(a.v, b.v) }; }
+inline IV Min(IV a, IV b) { return { _mm512_min_epi32(a.v, b.v) }; }
+inline IV Max(IV a, IV b) { return { _mm512_max_epi32(a.v, b.v) }; }
+template <int N> inline IV ShiftRight(IV a) { return { _mm512_srai_epi32(a.v, N) }; } // arithmetic
+inline IV RoundToInt(FV a) { return { _mm512_cvtps_epi32(a.v) }; }
+inline FV ToFloat(IV a) { return { _mm512_cvtepi32_ps(a.v) }; }
+// Sign-extending load and saturating store of 16 int16s.
+inline IV LoadInt16(const int16_t *p) {
+    return { _mm512_cvtepi16_epi32(_mm256_loadu_si256((const __m256i *)p)) };
+}
+inline void StoreInt16(int16_t *p, IV a) { _mm256_storeu_si256((__m256i *)p, _mm512_cvtsepi32_epi16(a.v)); }
+#define MLM_SIMD_F16C 1
+inline FV LoadHalf(const uint16_t *p) { return { _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i *)p)) }; }
+inline void StoreHalf(uint16_t *p, FV a) {
+    _mm256_storeu_si256((__m256i *)p, _mm512_cvtps_ph(a.v, _MM_FROUND_TO_NEAREST_INT));
+}
+inline FV Gather(const float *table, IV index) { return { _mm512_i32gather_ps(index.v, table, 4) }; }
+inline IV Gather(const uint32_t *table, IV index) { return { _mm512_i32gather_epi32(index.v, table, 4) }; }
+
+inline const char *Name() { return "AVX-512"; }
+
+#elif defined(MLM_SIMD_AVX2)
+
+struct FV { __m256 v; };
+struct IV { __m256i v; };
+struct MV { __m256 v; };
+
+inline FV Load(const float *p) { return { _mm256_loadu_ps(p) }; }
+inline void Store(float *p, FV a) { _mm256_storeu_ps(p, a.v); }
+inline FV Broadcast(float s) { return { _mm256_set1_ps(s) }; }
+
+inline FV operator+(FV a, FV b) { return { _mm256_add_ps(a.v, b.v) }; }
+inline FV operator-(FV a, FV b) { return { _mm256_sub_ps(a.v, b.v) }; }
+inline FV operator*(FV a, FV b) { return { _mm256_mul_ps(a.v, b.v) }; }
+inline FV operator/(FV a, FV b) { return { _mm256_div_ps(a.v, b.v) }; }
+inline FV Sqrt(FV a) { return { _mm256_sqrt_ps(a.v) }; }
+inline FV Min(FV a, FV b) { return { _mm256_min_ps(a.v, b.v) }; }
+inline FV Max(FV a, FV b) { return { _mm256_max_ps(a.v, b.v) }; }
+inline FV Abs(FV a) { return { _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v) }; }
+
+inline MV operator>(FV a, FV b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ) }; }
+inline MV operator<(FV a, FV b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ) }; }
+inline MV operator&(MV a, MV b) { return { _mm256_and_ps(a.v, b.v) }; }
+inline MV AndNot(MV a, MV b) { return { _mm256_andnot_ps(a.v, b.v) }; } // !a & b
+inline FV Select(MV m, FV a, FV b) { return { _mm256_blendv_ps(b.v, a.v, m.v) }; } // m ? a : b
+
+inline IV BroadcastInt(int32_t s) { return { _mm256_set1_epi32(s) }; }
+inline IV LoadInt(const int32_t *p) { return { _mm256_loadu_si256((const __m256i *)p) }; }
+inline IV TruncateToInt(FV a) { return { _mm256_cvttps_epi32(a.v) }; }
+inline IV operator|(IV a, IV b) { return { _mm256_or_si256(a.v, b.v) }; }
+template <int N> inline IV ShiftLeft(IV a) { return { _mm256_slli_epi32(a.v, N) }; }
+inline void Store(uint32_t *p, IV a) { _mm256_storeu_si256((__m256i *)p, a.v); }
+inline IV operator+(IV a, IV b) { return { _mm256_add_epi32(a.v, b.v) }; }
+inline IV operator-(IV a, IV b) { return { _mm256_sub_epi32(a.v, b.v) }; }
+inline IV operator*(IV a, IV b) { return { _mm256_mullo_epi32(a.v, b.v) }; }
+inline IV operator&(IV a, IV b) { return { _mm256_and_si256(a.v, b.v) }; }
+inline IV Min(IV a, IV b) { return { _mm256_min_epi32(a.v, b.v) }; }
+inline IV Max(IV a, IV b) { return { _mm256_max_epi32(a.v, b.v) }; }
+template <int N> inline IV ShiftRight(IV a) { return { _mm256_srai_epi32(a.v, N) }; } // arithmetic
+inline IV RoundToInt(FV a) { return { _mm256_cvtps_epi32(a.v) }; }
+inline FV ToFloat(IV a) { return { _mm256_cvtepi32_ps(a.v) }; }
+// Sign-extending load and saturating store of kLanes int16s.
+inline IV LoadInt16(const int16_t *p) {
+    return { _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)p)) };
+}
+inline void StoreInt16(int16_t *p, IV a) {
+    __m128i packed = _mm_packs_epi32(_mm256_castsi256_si128(a.v), _mm256_extracti128_si256(a.v, 1));
+    _mm_storeu_si128((__m128i *)p, packed);
+}
+#if defined(__F16C__) || defined(_MSC_VER)
+#define MLM_SIMD_F16C 1
+inline FV LoadHalf(const uint16_t *p) { return { _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)p)) }; }
+inline void StoreHalf(uint16_t *p, FV a) {
+    _mm_storeu_si128((__m128i *)p, _mm256_cvtps_ph(a.v, _MM_FROUND_TO_NEAREST_INT));
+}
+#endif
+inline FV Gather(const float *table, IV index) { return { _mm256_i32gather_ps(table, index.v, 4) }; }
+inline IV Gather(const uint32_t *table, IV index) {
+    return { _mm256_i32gather_epi32((const int *)table, index.v, 4) };
+}
+
+inline const char *Name() { return "AVX2"; }
+
+#elif defined(MLM_SIMD_SSE41)
+
+struct FV { __m128 lo, hi; };
+struct IV { __m128i lo, hi; };
+struct MV { __m128 lo, hi; };
+
+inline FV Load(const float *p) { return { _mm_loadu_ps(p), _mm_loadu_ps(p + 4) }; }
+inline void Store(float *p, FV a) { _mm_storeu_ps(p, a.lo); _mm_storeu_ps(p + 4, a.hi); }
+inline FV Broadcast(float s) { __m128 b = _mm_set1_ps(s); return { b, b }; }
+
+inline FV operator+(FV a, FV b) { return { _mm_add_ps(a.lo, b.lo), _mm_add_ps(a.hi, b.hi) }; }
+inline FV operator-(FV a, FV b) { return { _mm_sub_ps(a.lo, b.lo), _mm_sub_ps(a.hi, b.hi) }; }
+inline FV operator*(FV a, FV b) { return { _mm_mul_ps(a.lo, b.lo), _mm_mul_ps(a.hi, b.hi) }; }
+inline FV operator/(FV a, FV b) { return { _mm_div_ps(a.lo, b.lo), _mm_div_ps(a.hi, b.hi) }; }
+inline FV Sqrt(FV a) { return { _mm_sqrt_ps(a.lo), _mm_sqrt_ps(a.hi) }; }
+inline FV Min(FV a, FV b) { return { _mm_min_ps(a.lo, b.lo), _mm_min_ps(a.hi, b.hi) }; }
+inline FV Max(FV a, FV b) { return { _mm_max_ps(a.lo, b.lo), _mm_max_ps(a.hi, b.hi) }; }
+inline FV Abs(FV a) {
+    __m128 sign = _mm_set1_ps(-0.0f);
+    return { _mm_andnot_ps(sign, a.lo), _mm_andnot_ps(sign, a.hi) };
+}
+
+inline MV operator>(FV a, FV b) { return { _mm_cmpgt_ps(a.lo, b.lo), _mm_cmpgt_ps(a.hi, b.hi) }; }
+inline MV operator<(FV a, FV b) { return { _mm_cmplt_ps(a.lo, b.lo), _mm_cmplt_ps(a.hi, b.hi) }; }
+inline MV operator&(MV a, MV b) { return { _mm_and_ps(a.lo, b.lo), _mm_and_ps(a.hi, b.hi) }; }
+inline MV AndNot(MV a, MV b) { return { _mm_andnot_ps(a.lo, b.lo), _mm_andnot_ps(a.hi, b.hi) }; }
+inline FV Select(MV m, FV a, FV b) {
+    return { _mm_blendv_ps(b.lo, a.lo, m.lo), _mm_blendv_ps(b.hi, a.hi, m.hi) };
+}
+
+inline IV BroadcastInt(int32_t s) { __m128i b = _mm_set1_epi32(s); return { b, b }; }
+inline IV LoadInt(const int32_t *p) {
+    return { _mm_loadu_si128((const __m128i *)p), _mm_loadu_si128((const __m128i *)(p + 4)) };
+}
+inline IV TruncateToInt(FV a) { return { _mm_cvttps_epi32(a.lo), _mm_cvttps_epi32(a.hi) }; }
+inline IV operator|(IV a, IV b) { return { _mm_or_si128(a.lo, b.lo), _mm_or_si128(a.hi, b.hi) }; }
+template <int N> inline IV ShiftLeft(IV a) { return { _mm_slli_epi32(a.lo, N), _mm_slli_epi32(a.hi, N) }; }
+inline void Store(uint32_t *p, IV a) {
+    _mm_storeu_si128((__m128i *)p, a.lo);
+    _mm_storeu_si128((__m128i *)(p + 4), a.hi);
+}
+inline IV operator+(IV a, IV b) { return { _mm_add_epi32(a.lo, b.lo), _mm_add_epi32(a.hi, b.hi) }; }
+inline IV operator-(IV a, IV b) { return { _mm_sub_epi32(a.lo, b.lo), _mm_sub_epi32(a.hi, b.hi) }; }
+inline IV operator*(IV a, IV b) { return { _mm_mullo_epi32(a.lo, b.lo), _mm_mullo_epi32(a.hi, b.hi) }; }
+inline IV operator&(IV a, IV b) { return { _mm_and_si128(a.lo, b.lo), _mm_and_si128(a.hi, b.hi) }; }
+inline IV Min(IV a, IV b) { return { _mm_min_epi32(a.lo, b.lo), _mm_min_epi32(a.hi, b.hi) }; }
+inline IV Max(IV a, IV b) { return { _mm_max_epi32(a.lo, b.lo), _mm_max_epi32(a.hi, b.hi) }; }
+template <int N> inline IV ShiftRight(IV a) { return { _mm_srai_epi32(a.lo, N), _mm_srai_epi32(a.hi, N) }; }
+inline IV RoundToInt(FV a) { return { _mm_cvtps_epi32(a.lo), _mm_cvtps_epi32(a.hi) }; }
+inline FV ToFloat(IV a) { return { _mm_cvtepi32_ps(a.lo), _mm_cvtepi32_ps(a.hi) }; }
+inline IV LoadInt16(const int16_t *p) {
+    return { _mm_cvtepi16_epi32(_mm_loadl_epi64((const __m128i *)p)),
+             _mm_cvtepi16_epi32(_mm_loadl_epi64((const __m128i *)(p + 4))) };
+}
+inline void StoreInt16(int16_t *p, IV a) { _mm_storeu_si128((__m128i *)p, _mm_packs_epi32(a.lo, a.hi)); }
+#if defined(__F16C__)
+#define MLM_SIMD_F16C 1
+inline FV LoadHalf(const uint16_t *p) {
+    return { _mm_cvtph_ps(_mm_loadl_epi64((const __m128i *)p)),
+             _mm_cvtph_ps(_mm_loadl_epi64((const __m128i *)(p + 4))) };
+}
+inline void StoreHalf(uint16_t *p, FV a) {
+    __m128i lo = _mm_cvtps_ph(a.lo, _MM_FROUND_TO_NEAREST_INT);
+    __m128i hi = _mm_cvtps_ph(a.hi, _MM_FROUND_TO_NEAREST_INT);
+    _mm_storeu_si128((__m128i *)p, _mm_unpacklo_epi64(lo, hi));
+}
+#endif
+inline FV Gather(const float *table, IV index) {
+    alignas(16) int32_t i[kLanes];
+    _mm_store_si128((__m128i *)i, index.lo);
+    _mm_store_si128((__m128i *)(i + 4), index.hi);
+    return { _mm_setr_ps(table[i[0]], table[i[1]], table[i[2]], table[i[3]]),
+             _mm_setr_ps(table[i[4]], table[i[5]], table[i[6]], table[i[7]]) };
+}
+inline IV Gather(const uint32_t *table, IV index) {
+    alignas(16) int32_t i[kLanes];
+    _mm_store_si128((__m128i *)i, index.lo);
+    _mm_store_si128((__m128i *)(i + 4), index.hi);
+    return { _mm_setr_epi32((int)table[i[0]], (int)table[i[1]], (int)table[i[2]], (int)table[i[3]]),
+             _mm_setr_epi32((int)table[i[4]], (int)table[i[5]], (int)table[i[6]], (int)table[i[7]]) };
+}
+
+inline const char *Name() { return "SSE4.1"; }
+
+#else
+
+struct FV { float v[kLanes]; };
+struct IV { int32_t v[kLanes]; };
+struct MV { bool v[kLanes]; };
+
+inline FV Load(const float *p) { FV r; for (int i = 0; i < kLanes; ++i) r.v[i] = p[i]; return r; }
+inline void Store(float *p, FV a) { for (int i = 0; i < kLanes; ++i) p[i] = a.v[i]; }
+inline FV Broadcast(float s) { FV r; for (int i = 0; i < kLanes; ++i) r.v[i] = s; return r; }
+
+inline FV operator+(FV a, FV b) { for (int i = 0; i < kLanes; ++i) a.v[i] += b.v[i]; return a; }
+inline FV operator-(FV a, FV b) { for (int i = 0; i < kLanes; ++i) a.v[i] -= b.v[i]; return a; }
+inline FV operator*(FV a, FV b) { for (int i = 0; i < kLanes; ++i) a.v[i] *= b.v[i]; return a; }
+inline FV operator/(FV a, FV b) { for (int i = 0; i < kLanes; ++i) a.v[i] /= b.v[i]; return a; }
+inline FV Sqrt(FV a) { for (int i = 0; i < kLanes; ++i) a.v[i] = std::sqrt(a.v[i]); return a; }
+inline FV Min(FV a, FV b) { for (int i = 0; i < kLanes; ++i) a.v[i] = b.v[i] < a.v[i] ? b.v[i] : a.v[i]; return a; }
+inline FV Max(FV a, FV b) { for (int i = 0; i < kLanes; ++i) a.v[i] = b.v[i] > a.v[i] ? b.v[i] : a.v[i]; return a; }
+inline FV Abs(FV a) { for (int i = 0; i < kLanes; ++i) a.v[i] = a.v[i] < 0.0f ? -a.v[i] : a.v[i]; return a; }
+
+inline MV operator>(FV a, FV b) { MV m; for (int i = 0; i < kLanes; ++i) m.v[i] = a.v[i] > b.v[i]; return m; }
+inline MV operator<(FV a, FV b) { MV m; for (int i = 0; i < kLanes; ++i) m.v[i] = a.v[i] < b.v[i]; return m; }
+inline MV operator&(MV a, MV b) { for (int i = 0; i < kLanes; ++i) a.v[i] = a.v[i] && b.v[i]; return a; }
+inline MV AndNot(MV a, MV b) { for (int i = 0; i < kLanes; ++i) a.v[i] = !a.v[i] && b.v[i]; return a; }
+inline FV Select(MV m, FV a, FV b) { for (int i = 0; i < kLanes; ++i) a.v[i] = m.v[i] ? a.v[i] : b.v[i]; return a; }
+
+inline IV BroadcastInt(int32_t s) { IV r; for (int i = 0; i < kLanes; ++i) r.v[i] = s; return r; }
+inline IV LoadInt(const int32_t *p) { IV r; std::memcpy(r.v, p, sizeof(r.v)); return r; }
+inline IV TruncateToInt(FV a) { IV r; for (int i = 0; i < kLanes; ++i) r.v[i] = (int32_t)a.v[i]; return r; }
+inline IV operator|(IV a, IV b) { for (int i = 0; i < kLanes; ++i) a.v[i] |= b.v[i]; return a; }
+template <int N> inline IV ShiftLeft(IV a) { for (int i = 0; i < kLanes; ++i) a.v[i] = (int32_t)((uint32_t)a.v[i] << N); return a; }
+inline void Store(uint32_t *p, IV a) { std::memcpy(p, a.v, sizeof(a.v)); }
+inline IV operator+(IV a, IV b) { for (int i = 0; i < kLanes; ++i) a.v[i] += b.v[i]; return a; }
+inline IV operator-(IV a, IV b) { for (int i = 0; i < kLanes; ++i) a.v[i] -= b.v[i]; return a; }
+inline IV operator*(IV a, IV b) { for (int i = 0; i < kLanes; ++i) a.v[i] = (int32_t)((uint32_t)a.v[i] * (uint32_t)b.v[i]); return a; }
+inline IV operator&(IV a, IV b) { for (int i = 0; i < kLanes; ++i) a.v[i] &= b.v[i]; return a; }
+inline IV Min(IV a, IV b) { for (int i = 0; i < kLanes; ++i) a.v[i] = b.v[i] < a.v[i] ? b.v[i] : a.v[i]; return a; }
+inline IV Max(IV a, IV b) { for (int i = 0; i < kLanes; ++i) a.v[i] = b.v[i] > a.v[i] ? b.v[i] : a.v[i]; return a; }
+template <int N> inline IV ShiftRight(IV a) { for (int i = 0; i < kLanes; ++i) a.v[i] >>= N; return a; }
+inline IV RoundToInt(FV a) { IV r; for (int i = 0; i < kLanes; ++i) r.v[i] = (int32_t)std::nearbyint(a.v[i]); return r; }
+inline FV ToFloat(IV a) { FV r; for (int i = 0; i < kLanes; ++i) r.v[i] = (float)a.v[i]; return r; }
+inline IV LoadInt16(const int16_t *p) { IV r; for (int i = 0; i < kLanes; ++i) r.v[i] = p[i]; return r; }
+inline void StoreInt16(int16_t *p, IV a) {
+    for (int i = 0; i < kLanes; ++i)
+        p[i] = (int16_t)(a.v[i] < -32768 ? -32768 : a.v[i] > 32767 ? 32767 : a.v[i]);
+}
+inline FV Gather(const float *table, IV index) { FV r; for (int i = 0; i < kLanes; ++i) r.v[i] = table[index.v[i]]; return r; }
+inline IV Gather(const uint32_t *table, IV index) { IV r; for (int i = 0; i < kLanes; ++i) r.v[i] = (int32_t)table[index.v[i]]; return r; }
+
+inline const char *Name() { return "scalar"; }
+
+#endif
+
+#if !defined(MLM_SIMD_F16C)
+inline FV LoadHalf(const uint16_t *p) {
+    float f[kLanes];
+    for (int i = 0; i < kLanes; ++i)
+        f[i] = HalfToFloat(p[i]);
+    return Load(f);
+}
+inline void StoreHalf(uint16_t *p, FV a) {
+    float f[kLanes];
+    Store(f, a);
+    for (int i = 0; i < kLanes; ++i)
+        p[i] = FloatToHalf(f[i]);
+}
+#endif
+
+} // inline namespace
+} // namespace simd
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent worker pool for the row-band kernels.
+//
+// Threads are started once and parked on a condition variable between
+// jobs. ParallelFor() splits a range into one contiguous band per thread,
+// runs band 0 on the calling thread and returns once every band is done,
+// so each call is exactly one barrier.
+class ThreadPool {
+public:
+    // threads <= 0 uses std::thread::hardware_concurrency(). The count
+    // includes the calling thread, so a pool of 1 never starts a worker.
+    explicit ThreadPool(int threads = 0) {
+        if (threads <= 0)
+            threads = (int)std::max(1u, std::thread::hardware_concurrency());
+        for (int i = 1; i < threads; ++i)
+            workers.emplace_back([this, i] { WorkerLoop(i); });
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        wake.notify_all();
+        for (std::thread &t : workers)
+            t.join();
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    int Size() const { return (int)workers.size() + 1; }
+
+    // Calls fn(bandBegin, bandEnd) over [begin, end). Bands are at least
+    // minGrain items long, so small ranges use fewer threads.
+    template <typename Fn>
+    void ParallelFor(int begin, int end, Fn &&fn, int minGrain = 1) {
+        int count = end - begin;
+        if (count <= 0)
+            return;
+        int bands = std::min(Size(), std::max(1, count / std::max(1, minGrain)));
+        if (bands == 1) {
+            fn(begin, end);
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job.fn = &Invoke<Fn>;
+            job.ctx = &fn;
+            job.begin = begin;
+            job.end = end;
+            job.bands = bands;
+            pending = Size() - 1;
+            ++generation;
+        }
+        wake.notify_all();
+
+        RunBand(0);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return pending == 0; });
+    }
+
+private:
+    struct Job {
+        void (*fn)(void *, int, int) = nullptr;
+        void *ctx = nullptr;
+        int begin = 0;
+        int end = 0;
+        int bands = 0;
+    };
+
+    template <typename Fn>
+    static void Invoke(void *ctx, int b, int e) { (*static_cast<Fn *>(ctx))(b, e); }
+
+    void RunBand(int band) {
+        if (band >= job.bands)
+            return;
+        int count = job.end - job.begin;
+        int b = job.begin + (int)((long long)count * band / job.bands);
+        int e = job.begin + (int)((long long)count * (band + 1) / job.bands);
+        job.fn(job.ctx, b, e);
+    }
+
+    void WorkerLoop(int band) {
+        unsigned long long seen = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return quit || generation != seen; });
+                if (quit)
+                    return;
+                seen = generation;
+            }
+
+            RunBand(band);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--pending == 0)
+                done.notify_one();
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    Job job;
+    unsigned long long generation = 0;
+    int pending = 0;
+    bool quit = false;
+};
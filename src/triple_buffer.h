@@ -0,0 +1,39 @@
+#pragma once
+
+#include <atomic>
+
+// Lock-free single-producer, single-consumer triple buffer.
+//
+// The producer fills Back() and calls Publish(), which swaps it with the
+// shared middle slot. The consumer calls Acquire(), which swaps the middle
+// slot into Front() when it holds a newer publication. Each side always
+// owns one slot outright, so neither ever waits, and the consumer always
+// gets the newest complete value (unread older ones are overwritten).
+template <typename T>
+class TripleBuffer {
+public:
+    // Producer side.
+    T &Back() { return slots[back]; }
+    void Publish() {
+        back = middle.exchange(back | kFresh, std::memory_order_acq_rel) & kIndex;
+    }
+
+    // Consumer side. Returns false (and keeps Front()) if nothing new was
+    // published since the last call.
+    bool Acquire() {
+        if (!(middle.load(std::memory_order_relaxed) & kFresh))
+            return false;
+        front = middle.exchange(front, std::memory_order_acq_rel) & kIndex;
+        return true;
+    }
+    T &Front() { return slots[front]; }
+
+private:
+    static constexpr int kIndex = 3;
+    static constexpr int kFresh = 4;
+
+    T slots[3];
+    std::atomic<int> middle{ 1 };
+    int front = 0;
+    int back = 2;
+};
@@ -0,0 +1,33 @@
+#include "liquid_sim.h"
+
+#include <cstdio>
+
+// A surface that settles while Advance() runs temporal chunks has to go
+// back to sleep, or every later call stays dense.
+int main() {
+    for (int substeps : { 1, 2, 4 }) {
+        LiquidSim sim(256, 256, 2);
+        sim.temporalMinBytes = 0;  // block even though the grid fits in cache
+        for (int j = 0; j < 8; ++j) {
+            for (int i = 0; i < 8; ++i)
+                sim.AddImpulse(16 + 32 * i, 16 + 32 * j, 0.5f);
+        }
+
+        bool dense = false;
+        for (int call = 0; call < 12000 / substeps && sim.AwakeTileCount() > 0; ++call) {
+            dense = dense || sim.AwakeTileCount() * 2 >= sim.tilesX * sim.tilesY;
+            sim.Advance(substeps);
+        }
+
+        if (!dense) {
+            std::printf("Advance(%d): the surface never woke enough tiles to block\n", substeps);
+            return 1;
+        }
+        if (sim.AwakeTileCount() != 0) {
+            std::printf("Advance(%d): %d of %d tiles still awake\n", substeps,
+                        sim.AwakeTileCount(), sim.tilesX * sim.tilesY);
+            return 1;
+        }
+    }
+    return 0;
+}